@@ -8,15 +8,49 @@
  * Also measures and reports the runtime of the relaxation phase.
  *
  * Compile with:
- *   gcc -fopenmp -DN=512 -DM=512 -std=c99 -O3 -Wall -o sandpile_openmp sandpile_openmp.c
+ *   gcc -fopenmp -DN=512 -DM=512 -std=c99 -O3 -Wall -o sandpile_openmp sandpile_openmp.c \
+ *       sandpile_grid.c sandpile_kernel.c sandpile_redblack.c sandpile_temporal.c \
+ *       sandpile_tiles.c sandpile_bits.c sandpile_numa.c sandpile_steal.c \
+ *       sandpile_atomic.c sandpile_image.c -lz
+ *
+ * Run with --kernel=scalar|sse4.1|avx2|avx512 to override the row kernel
+ * picked from the CPU's feature flags, and with --init=centre to start from
+ * a single centre pile instead of 4 grains on every cell. --engine=redblack
+ * topples in place in red-black order instead of double buffering, and
+ * --engine=tiled skips tiles whose neighbourhood was stable last sweep.
+ * --engine=steal does the same with per-thread tile deques and stealing.
+ * --engine=atomic topples each thread's band in place with no barriers,
+ * handing grains across bands with atomic adds.
+ * --engine=temporal advances cache-sized tiles --depth=K sweeps at a time.
+ * The sync engine switches to bit-sliced cells once every height is below
+ * 8 unless run with --bitslice=off. --format=png writes sandpile_openmp.png,
+ * a 2-bit palette PNG deflated on all threads, instead of the PPM.
+ *
+ * Grids are initialised and relaxed in the same row bands (sandpile_bands.h)
+ * so that first-touch placement puts each band on its thread's NUMA node.
+ * --bind=close|spread pins the threads and --numa-report prints where each
+ * band's thread runs and which node holds its rows.
  */
 
+ #define _POSIX_C_SOURCE 199309L  /* clock_gettime under -std=c99 */
+
  #include <stdio.h>
  #include <stdlib.h>
  #include <stdbool.h>
+ #include <string.h>
  #include <time.h>
  #include <omp.h>
  
+ #include "sandpile_bands.h"
+ #include "sandpile_bits.h"
+ #include "sandpile_engine.h"
+ #include "sandpile_grid.h"
+ #include "sandpile_image.h"
+ #include "sandpile_numa.h"
+ #include "sandpile_steal.h"
+ #include "sandpile_temporal.h"
+ #include "sandpile_tiles.h"
+ 
  #ifndef N
  #define N 512   /* number of interior rows */
  #endif
@@ -25,107 +59,449 @@
  #define M 512   /* number of interior columns */
  #endif
  
+ /* Relaxation engines selectable with --engine= */
+ enum engine {
+     ENGINE_SYNC,      /* parallel synchronous double-buffered sweep (default) */
+     ENGINE_REDBLACK,  /* in-place red-black toppling, see relax_redblack */
+     ENGINE_TILED,     /* synchronous sweep of the active tiles only */
+     ENGINE_TEMPORAL,  /* synchronous sweeps, temporally blocked per tile */
+     ENGINE_STEAL,     /* active tiles only, scheduled by work stealing */
+     ENGINE_ATOMIC     /* in-place, barrier-free, see relax_atomic */
+ };
+ 
+ /**
+  * report_bands
+  * ------------
+  * Print, for each thread, its row band, the CPU it runs on and the NUMA
+  * node holding most of the band's rows in the current buffer.
+  */
+ static void report_bands(const sandpile_grid *grid) {
+     #pragma omp parallel
+     {
+         int y0, y1;
+         band_rows(grid->rows, band_index(), band_count(), &y0, &y1);
+         size_t row_bytes = grid->cols * cell_size(grid->type);
+         double share = 0;
+         int node = page_node((const char *)grid->sand + y0 * row_bytes,
+                              (y1 - y0) * row_bytes, &share);
+         int cpu = current_cpu();
+         #pragma omp for ordered schedule(static, 1)
+         for (int t = 0; t < band_count(); t++) {
+             #pragma omp ordered
+             if (node >= 0) {
+                 fprintf(stderr, "[OpenMP] Band %d: rows %d-%d, CPU %d, node %d (%.0f%% of pages)\n",
+                         t, y0, y1 - 1, cpu, node, 100 * share);
+             } else {
+                 fprintf(stderr, "[OpenMP] Band %d: rows %d-%d, CPU %d, node unknown\n",
+                         t, y0, y1 - 1, cpu);
+             }
+         }
+     }
+ }
+ 
+ /* Change flag of one thread, and the heights of its rows at the last
+  * narrowing check, alone on a cache line */
+ typedef struct {
+     int      changed;
+     uint32_t max;    /* largest height in the current state */
+     uint32_t bound;  /* the same over both buffers */
+     char     pad[64 - sizeof(int) - 2 * sizeof(uint32_t)];
+ } sweep_flag;
+ 
  /**
-  * sync_compute_new_state
-  * ----------------------
-  * Compute the next state of a single cell (y, x) in the sandpile grid
-  * using a synchronous update. It sums the remainder of the current cell
-  * modulo 4 plus one quarter of each of its four neighbors. Writes the
-  * result into the 'next' grid and returns 1 if the cell value changed,
-  * 0 otherwise.
+  * relax_sync
+  * ----------
+  * Run the synchronous sweep to the stable state inside one parallel
+  * region. Each thread owns a fixed band of rows for the whole run and
+  * publishes whether its band changed in a flag of its own; after the single
+  * barrier that ends a sweep every thread ORs all the flags and so reaches
+  * the same decision to stop. The flags alternate between two sets by sweep
+  * parity, so a set is only rewritten once the barrier of the following
+  * sweep guarantees that everyone has read it.
+  *
+  * The same flags let a band sit out a sweep: if it and the bands whose rows
+  * border it did not change in the previous sweep, sweeping it would only
+  * rewrite 'next' with what it already holds, so the thread just swaps its
+  * pointers. The first sweep, and the first on bit planes (whose 'next'
+  * starts zeroed), sweep every band.
+  *
+  * Every NARROW_INTERVAL sweeps each thread bounds the heights of its own
+  * rows in its flag, and one thread then decides whether to narrow the
+  * cells and, with 'bitslice', to switch to bit planes once every height is
+  * below BITS_MAX_HEIGHT, at the cost of two more barriers. It only
+  * allocates the new buffers: every thread converts its own rows into them,
+  * behind one more barrier, so that they stay on its NUMA node. Each thread
+  * swaps its own copy of the buffer pointers, and the shared grid is updated
+  * at those points and at the end. Returns the number of sweeps, or -1 if
+  * the flags cannot be allocated.
   */
- static inline int sync_compute_new_state(int *sand, int *next, int cols, int y, int x) {
-     int idx = y * cols + x;
-     next[idx] = sand[idx] % 4
-               + sand[idx - 1]    / 4  /* left neighbor */
-               + sand[idx + 1]    / 4  /* right neighbor */
-               + sand[idx - cols] / 4  /* above neighbor */
-               + sand[idx + cols] / 4; /* below neighbor */
-     return next[idx] != sand[idx];
+ static long relax_sync(sandpile_grid *grid, bool bitslice) {
+     sweep_flag *flags = calloc(2 * (size_t)omp_get_max_threads(), sizeof *flags);
+     if (!flags) {
+         return -1;
+     }
+ 
+     long iterations = 0, skipped = 0;
+     int bands = 1;
+     bit_grid bits;
+     bool bitsliced = false;
+     sandpile_grid repacked;  /* narrower buffers being filled */
+     bool narrow = false;
+     #pragma omp parallel
+     {
+         const int tid = band_index(), team = band_count();
+         int y0, y1;
+         band_rows(grid->rows, tid, team, &y0, &y1);
+         /* Bands bordering this one: with more threads than rows some bands
+          * are empty, so the nearest ones with rows above and below */
+         int up = tid - 1, down = tid + 1;
+         for (int u0, u1; up >= 0; up--) {
+             band_rows(grid->rows, up, team, &u0, &u1);
+             if (u0 < u1) {
+                 break;
+             }
+         }
+         for (int d0, d1; down < team; down++) {
+             band_rows(grid->rows, down, team, &d0, &d1);
+             if (d0 < d1) {
+                 break;
+             }
+         }
+         sandpile_grid local = *grid;
+         bit_grid local_bits;
+         bool local_bitsliced = false;
+         long sweep = 0, check_at = 0, idle = 0;
+         bool changed = true;
+         bool all = true;  /* sweep the band whatever the flags say */
+         while (changed) {
+             if (!local_bitsliced && sweep >= check_at) {
+                 check_at = sweep + NARROW_INTERVAL;
+                 /* 'next' only holds a state once a sweep has been made */
+                 int t0, t1;
+                 band_touch_rows(local.rows, tid, team, &t0, &t1);
+                 flags[tid].max = grid_max_rows(&local, t0, t1);
+                 flags[tid].bound = sweep > 0 ? grid_bound_rows(&local, t0, t1) : flags[tid].max;
+                 #pragma omp barrier
+                 #pragma omp single
+                 {
+                     uint32_t max = 0, bound = 0;
+                     for (int t = 0; t < team; t++) {
+                         max = flags[t].max > max ? flags[t].max : max;
+                         bound = flags[t].bound > bound ? flags[t].bound : bound;
+                     }
+                     *grid = local;
+                     /* Without memory for the narrower cells or the bit
+                      * planes, keep the current cells */
+                     cell_type type = cell_type_for_max(bound);
+                     narrow = sweep > 0 && type < grid->type &&
+                              grid_alloc(&repacked, type, grid->rows, grid->cols, 2) == 0;
+                     bitsliced = bitslice && max < BITS_MAX_HEIGHT &&
+                                 bits_alloc(&bits, grid->rows, grid->cols) == 0;
+                 }
+ 
+                 /* Each thread converts, and so first-touches, its own rows */
+                 if (narrow || bitsliced) {
+                     if (narrow) {
+                         grid_repack_rows(&local, &repacked, t0, t1);
+                     }
+                     if (bitsliced) {
+                         bits_load_rows(&bits, narrow ? &repacked : &local, t0, t1);
+                     }
+                     #pragma omp barrier
+                     #pragma omp single
+                     {
+                         if (narrow) {
+                             grid_free(grid);
+                             *grid = repacked;
+                             fprintf(stderr, "[OpenMP] Cell type: %s after %ld sweeps\n",
+                                     cell_type_name(grid->type), sweep);
+                         }
+                         if (bitsliced) {
+                             fprintf(stderr, "[OpenMP] Cell type: bit-sliced after %ld sweeps\n",
+                                     sweep);
+                         }
+                     }
+                 }
+                 local = *grid;
+                 if (bitsliced) {
+                     local_bits = bits;
+                     local_bitsliced = true;
+                     all = true;
+                 }
+             }
+ 
+             /* Sweep the own band, unless it and its neighbours were stable */
+             const sweep_flag *last = flags + ((sweep + 1) & 1) * team;
+             bool active = all || last[tid].changed ||
+                           (up >= 0 && last[up].changed) ||
+                           (down < team && last[down].changed);
+             all = false;
+             int mine = 0;
+             if (!active) {
+                 idle++;
+                 if (local_bitsliced) {
+                     bits_swap(&local_bits);
+                 } else {
+                     grid_swap(&local);
+                 }
+             } else if (local_bitsliced) {
+                 mine = bits_relax_rows(&local_bits, y0, y1);
+                 bits_swap(&local_bits);
+             } else {
+                 for (int y = y0; y < y1; y++) {
+                     mine |= grid_relax_row(&local, y);
+                 }
+                 grid_swap(&local);
+             }
+             sweep_flag *set = flags + (sweep & 1) * team;
+             set[tid].changed = mine;
+ 
+             #pragma omp barrier
+             changed = false;
+             for (int t = 0; t < team; t++) {
+                 changed |= set[t].changed;
+             }
+             sweep++;
+         }
+ 
+         #pragma omp atomic
+         skipped += idle;
+         #pragma omp master
+         {
+             iterations = sweep;
+             bands = team;
+             *grid = local;
+             if (bitsliced) {
+                 bits = local_bits;
+             }
+         }
+     }
+     free(flags);
+     fprintf(stderr, "[OpenMP] Bands skipped: %.1f%% of band sweeps\n",
+             100.0 * skipped / ((double)iterations * bands));
+ 
+     if (bitsliced) {
+         bits_store(&bits, grid);
+         bits_free(&bits);
+     }
+     return iterations;
  }
  
  int main(int argc, char *argv[]) {
+     /* Parse options */
+     const char *kernel = NULL;  /* NULL: widest kernel the CPU supports */
+     bool centre = false;        /* single centre pile instead of uniform 4 */
+     enum engine engine = ENGINE_SYNC;
+     int depth = TEMPORAL_DEPTH;  /* sweeps per block for --engine=temporal */
+     bool bitslice = true;       /* switch to bit planes once heights are small */
+     bind_policy bind = BIND_NONE;
+     bool numa_report = false;   /* print the placement of each row band */
+     bool png = false;           /* write a palette PNG instead of the PPM */
+     for (int i = 1; i < argc; i++) {
+         if (strncmp(argv[i], "--kernel=", 9) == 0) {
+             kernel = argv[i] + 9;
+         } else if (strcmp(argv[i], "--init=centre") == 0) {
+             centre = true;
+         } else if (strcmp(argv[i], "--init=uniform") == 0) {
+             centre = false;
+         } else if (strcmp(argv[i], "--engine=sync") == 0) {
+             engine = ENGINE_SYNC;
+         } else if (strcmp(argv[i], "--engine=redblack") == 0) {
+             engine = ENGINE_REDBLACK;
+         } else if (strcmp(argv[i], "--engine=tiled") == 0) {
+             engine = ENGINE_TILED;
+         } else if (strcmp(argv[i], "--engine=temporal") == 0) {
+             engine = ENGINE_TEMPORAL;
+         } else if (strcmp(argv[i], "--engine=steal") == 0) {
+             engine = ENGINE_STEAL;
+         } else if (strcmp(argv[i], "--engine=atomic") == 0) {
+             engine = ENGINE_ATOMIC;
+         } else if (strcmp(argv[i], "--bitslice=auto") == 0) {
+             bitslice = true;
+         } else if (strcmp(argv[i], "--bitslice=off") == 0) {
+             bitslice = false;
+         } else if (strcmp(argv[i], "--bind=none") == 0) {
+             bind = BIND_NONE;
+         } else if (strcmp(argv[i], "--bind=close") == 0) {
+             bind = BIND_CLOSE;
+         } else if (strcmp(argv[i], "--bind=spread") == 0) {
+             bind = BIND_SPREAD;
+         } else if (strcmp(argv[i], "--format=ppm") == 0) {
+             png = false;
+         } else if (strcmp(argv[i], "--format=png") == 0) {
+             png = true;
+         } else if (strcmp(argv[i], "--numa-report") == 0) {
+             numa_report = true;
+         } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+             depth = atoi(argv[i] + 8);
+             if (depth < 1 || depth > TEMPORAL_MAX_DEPTH) {
+                 fprintf(stderr, "--depth must be between 1 and %d\n", TEMPORAL_MAX_DEPTH);
+                 return EXIT_FAILURE;
+             }
+         } else {
+             fprintf(stderr, "Usage: %s [--kernel=scalar|sse4.1|avx2|avx512]"
+                             " [--init=uniform|centre] [--engine=sync|redblack|tiled|temporal|steal|atomic]"
+                             " [--depth=K] [--bitslice=auto|off]"
+                             " [--bind=none|close|spread] [--numa-report] [--format=ppm|png]\n",
+                     argv[0]);
+             return EXIT_FAILURE;
+         }
+     }
+     const char *isa = relax_row_select(kernel);
+     if (!isa) {
+         fprintf(stderr, "Row kernel '%s' is unknown or not supported by this CPU\n", kernel);
+         return EXIT_FAILURE;
+     }
+     fprintf(stderr, "[OpenMP] Row kernel: %s\n", isa);
+ 
      const int height = N;
      const int width  = M;
      const int rows = height + 2;  /* include sink border */
      const int cols = width  + 2;
  
-     /* Allocate grids */
-     int *sand = malloc(rows * cols * sizeof(int));
-     int *next = malloc(rows * cols * sizeof(int));
-     if (!sand || !next) {
+     /* Allocate grids as 32-bit cells; they are narrowed once initialised.
+      * The in-place engines need no 'next' grid. */
+     const bool in_place = engine == ENGINE_REDBLACK || engine == ENGINE_ATOMIC;
+     sandpile_grid grid;
+     if (grid_alloc(&grid, CELL_U32, rows, cols, in_place ? 1 : 2) != 0) {
          perror("malloc");
          return EXIT_FAILURE;
      }
+     uint32_t *sand = grid.sand;
+     uint32_t *next = grid.next;
+ 
+     /* Pin the threads, then let each one first touch the rows it relaxes:
+      * zero them and, for the uniform start, set every interior cell to 4
+      * grains (unstable start) */
+     #pragma omp parallel
+     {
+         pin_thread(bind, band_index(), band_count());
+         int y0, y1;
+         band_touch_rows(rows, band_index(), band_count(), &y0, &y1);
+         for (int i = y0 * cols; i < y1 * cols; i++) {
+             sand[i] = 0;
+             if (next) {
+                 next[i] = 0;
+             }
+         }
+         if (!centre) {
+             for (int y = y0 > 1 ? y0 : 1; y < y1 && y <= height; y++) {
+                 for (int x = 1; x <= width; x++) {
+                     sand[y * cols + x] = 4;
+                 }
+             }
+         }
+     }
  
-     /* Initialize to zero */
-     #pragma omp parallel for
-     for (int i = 0; i < rows * cols; i++) {
-         sand[i] = next[i] = 0;
+     if (centre) {
+         /* Single huge centre pile */
+         int cy = height/2 + 1, cx = width/2 + 1;
+         sand[cy * cols + cx] = width * height;
      }
  
-     /* Set every interior cell to 4 grains (unstable start) */
-     #pragma omp parallel for collapse(2)
-     for (int y = 1; y <= height; y++) {
-         for (int x = 1; x <= width; x++) {
-             sand[y * cols + x] = 4;
-         }
+     /* Store cells in the narrowest type that holds every height reached.
+      * In-place toppling can pile grains higher, so it keeps 32-bit cells. */
+     if (!in_place) {
+         grid_narrow(&grid);
+     }
+     fprintf(stderr, "[OpenMP] Cell type: %s\n", cell_type_name(grid.type));
+     if (numa_report) {
+         report_bands(&grid);
+     }
+ 
+     tile_map tiles;
+     steal_sched sched;
+     const bool tiled = engine == ENGINE_TILED || engine == ENGINE_STEAL;
+     if (tiled && tiles_init(&tiles, height, width) != 0) {
+         perror("malloc");
+         return EXIT_FAILURE;
+     }
+     if (engine == ENGINE_STEAL && steal_init(&sched, &tiles) != 0) {
+         perror("malloc");
+         return EXIT_FAILURE;
      }
  
      /* Measure relaxation runtime */
      struct timespec t_start, t_end;
      clock_gettime(CLOCK_MONOTONIC, &t_start);
  
-     /* Relaxation: repeat until no cell changes */
-     bool changed = true;
-     while (changed) {
-         int changed_int = 0;
-         /* Parallel sweep of interior cells */
-         #pragma omp parallel for collapse(2) reduction(|:changed_int)
-         for (int y = 1; y <= height; y++) {
-             for (int x = 1; x <= width; x++) {
-                 changed_int |= sync_compute_new_state(sand, next, cols, y, x);
+     long iterations = 0;
+     if (engine == ENGINE_REDBLACK) {
+         iterations = relax_redblack(grid.sand, rows, cols);
+     } else if (engine == ENGINE_ATOMIC) {
+         iterations = relax_atomic(grid.sand, rows, cols);
+         if (iterations < 0) {
+             perror("malloc");
+             return EXIT_FAILURE;
+         }
+     } else if (engine == ENGINE_SYNC) {
+         iterations = relax_sync(&grid, bitslice);
+         if (iterations < 0) {
+             perror("malloc");
+             return EXIT_FAILURE;
+         }
+     } else {
+         /* Relaxation: repeat until no cell changes */
+         bool changed = true;
+         long narrow_at = NARROW_INTERVAL;
+         while (changed) {
+             int changed_int = 0;
+             int sweeps = 1;  /* sweeps advanced by this pass */
+             if (engine == ENGINE_TEMPORAL) {
+                 /* 'depth' sweeps per cache-resident tile */
+                 int stable_at = temporal_relax(&grid, depth);
+                 if (stable_at < 0) {
+                     perror("malloc");
+                     return EXIT_FAILURE;
+                 }
+                 sweeps = stable_at ? stable_at : depth;
+                 changed_int = stable_at == 0;
+             } else if (engine == ENGINE_STEAL) {
+                 /* Active tiles from per-thread deques, stealing when idle */
+                 changed_int = steal_relax(&sched, &tiles, &grid);
+             } else {
+                 /* Parallel sweep of the active tiles */
+                 changed_int = tiles_relax(&tiles, &grid);
+             }
+             changed = changed_int;
+             /* Swap buffers */
+             grid_swap(&grid);
+             iterations += sweeps;
+ 
+             /* Narrow the cells as heights drop (centre-pile runs) */
+             if (iterations >= narrow_at) {
+                 narrow_at = iterations + NARROW_INTERVAL;
+                 if (grid_narrow(&grid)) {
+                     fprintf(stderr, "[OpenMP] Cell type: %s after %ld sweeps\n",
+                             cell_type_name(grid.type), iterations);
+                 }
              }
          }
-         changed = changed_int;
-         /* Swap buffers */
-         int *tmp = sand;
-         sand = next;
-         next = tmp;
      }
  
      clock_gettime(CLOCK_MONOTONIC, &t_end);
      double elapsed = (t_end.tv_sec - t_start.tv_sec)
                      + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
      fprintf(stderr, "[OpenMP] Relaxation runtime: %.6f seconds\n", elapsed);
+     fprintf(stderr, "[OpenMP] Iterations: %ld\n", iterations);
+     if (tiled) {
+         fprintf(stderr, "[OpenMP] Active tiles: %.1f%% of %ld tile sweeps\n",
+                 100.0 * tiles.updated / tiles.visited, tiles.visited);
+         tiles_free(&tiles);
+     }
+     if (engine == ENGINE_STEAL) {
+         fprintf(stderr, "[OpenMP] Stolen tiles: %ld\n", sched.stolen);
+         steal_free(&sched);
+     }
  
-     /* Write P6 PPM */
-     FILE *fp = fopen("sandpile_openmp.ppm", "wb");
-     if (!fp) {
-         perror("fopen");
+     /* Write P6 PPM, or PNG */
+     const char *path = png ? "sandpile_openmp.png" : "sandpile_openmp.ppm";
+     if ((png ? image_write_png(&grid, path) : image_write_ppm(&grid, path)) != 0) {
+         perror(path);
          return EXIT_FAILURE;
      }
-     fprintf(fp, "P6\n%d %d\n255\n", width, height);
-     for (int y = 1; y <= height; y++) {
-         for (int x = 1; x <= width; x++) {
-             int v = sand[y * cols + x];
-             unsigned char r, g, b;
-             switch (v) {
-                 case 0: r = 0;   g = 0;   b = 0;   break;
-                 case 1: r = 0;   g = 255; b = 0;   break;
-                 case 2: r = 0;   g = 0;   b = 255; break;
-                 case 3: r = 255; g = 0;   b = 0;   break;
-                 default: r = g = b = 0;
-             }
-             fputc(r, fp);
-             fputc(g, fp);
-             fputc(b, fp);
-         }
-     }
-     fclose(fp);
-     fprintf(stderr, "Wrote sandpile_openmp.ppm (%dx%d)\n", width, height);
+     fprintf(stderr, "Wrote %s (%dx%d)\n", path, width, height);
  
-     free(sand);
-     free(next);
+     grid_free(&grid);
      return EXIT_SUCCESS;
  }
\ No newline at end of file
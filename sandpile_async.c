@@ -0,0 +1,66 @@
+/*
+ * sandpile_async.c
+ *
+ * In-place asynchronous (Gauss-Seidel) relaxation. Rows are toppled top to
+ * bottom directly in 'sand': every unstable cell of a row topples at once,
+ * and the grains it pushes into the row below are seen when that row is
+ * visited later in the same sweep. By the Abelian property the final stable
+ * state equals that of the synchronous engine, with half its memory
+ * footprint and fewer sweeps.
+ *
+ * Toppling a whole row at a time keeps the inner loops free of branches and
+ * of loop-carried dependencies, so they vectorise; a cell-at-a-time raster
+ * order would serialise on the grain just pushed to the right neighbour.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "sandpile_engine.h"
+
+/**
+ * topple_row
+ * ----------
+ * Topple every unstable cell of one interior row v / 4 times, using 'q' as
+ * scratch for the per-cell topple counts (q[0] and q[cols - 1] stay zero).
+ * Returns nonzero if any cell toppled.
+ */
+static uint32_t topple_row(uint32_t *restrict row, uint32_t *restrict above,
+                           uint32_t *restrict below, uint32_t *restrict q,
+                           int cols) {
+    uint32_t any = 0;
+    for (int x = 1; x < cols - 1; x++) {
+        q[x] = row[x] / 4;
+        any |= q[x];
+    }
+    for (int x = 1; x < cols - 1; x++) {
+        row[x] = row[x] % 4
+               + q[x - 1]   /* from left neighbor */
+               + q[x + 1];  /* from right neighbor */
+        above[x] += q[x];
+        below[x] += q[x];
+    }
+    return any;
+}
+
+long relax_async(uint32_t *sand, int rows, int cols) {
+    uint32_t *q = calloc(cols, sizeof *q);
+    if (!q) {
+        return -1;
+    }
+
+    long sweeps = 0;
+    bool toppled = true;
+    while (toppled) {
+        toppled = false;
+        for (int y = 1; y < rows - 1; y++) {
+            uint32_t *row = sand + (long)y * cols;
+            toppled |= topple_row(row, row - cols, row + cols, q, cols) != 0;
+        }
+        clear_sink(sand, rows, cols);
+        sweeps++;
+    }
+
+    free(q);
+    return sweeps;
+}
@@ -0,0 +1,182 @@
+/*
+ * sandpile_atomic.c
+ *
+ * Barrier-free asynchronous relaxation for the OpenMP engine. Each thread
+ * owns a row band (sandpile_bands.h) and topples it in place, pass after
+ * pass, without waiting for the others. Only the first and last row of a
+ * band can be written by another thread, when a cell of the neighbouring
+ * band topples grains across the cut, so only those rows are accessed with
+ * atomics; grains are handed over with an atomic add on the receiving
+ * cell, and a thread toppling a cell of such a row takes the grains off it
+ * with an atomic add as well. Neither ever waits for the other. By the
+ * Abelian property the order in which cells topple does not matter, so the
+ * final state is the synchronous engine's.
+ *
+ * Termination: a shared epoch counts the passes that toppled anything, and
+ * each thread publishes the epoch at which its latest clean pass (one that
+ * found its whole band stable) started. Grains only move in passes that are
+ * not clean, and such a pass bumps the epoch after its last hand-over. So
+ * once every thread's latest clean pass started at the current epoch, no
+ * grain has moved since any band was last seen stable, and the grid is
+ * stable. Nothing can topple after that, so every thread sees the same and
+ * stops.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_engine.h"
+
+/* Epoch at which a thread's latest clean pass started, alone on its line */
+typedef struct {
+    long clean;
+    char pad[64 - sizeof(long)];
+} pass_flag;
+
+/* Add q[x] grains to every interior cell of a row, atomically if another
+ * thread may write it as well */
+static void hand_over(uint32_t *restrict row, const uint32_t *restrict q, int cols,
+                      bool shared) {
+    if (shared) {
+        for (int x = 1; x < cols - 1; x++) {
+            if (q[x]) {
+                #pragma omp atomic
+                row[x] += q[x];
+            }
+        }
+    } else {
+        for (int x = 1; x < cols - 1; x++) {
+            row[x] += q[x];
+        }
+    }
+}
+
+/**
+ * topple_row
+ * ----------
+ * Topple every unstable cell of interior row y of band [y0, y1) v / 4 times,
+ * using 'q' as scratch for the per-cell topple counts (q[0] and q[cols - 1]
+ * stay zero). Grains falling into the sink are dropped. Returns nonzero if
+ * any cell toppled.
+ */
+static uint32_t topple_row(uint32_t *restrict sand, int rows, int cols, int y, int y0, int y1,
+                           uint32_t *restrict q) {
+    uint32_t *row = sand + (long)y * cols;
+    const bool shared = y == y0 || y == y1 - 1;
+    uint32_t any = 0;
+
+    if (shared) {
+        for (int x = 1; x < cols - 1; x++) {
+            uint32_t v;
+            #pragma omp atomic read
+            v = row[x];
+            q[x] = v / 4;
+            any |= q[x];
+        }
+    } else {
+        for (int x = 1; x < cols - 1; x++) {
+            q[x] = row[x] / 4;
+            any |= q[x];
+        }
+    }
+    if (!any) {
+        return 0;
+    }
+
+    if (shared) {
+        /* Grains may arrive from the next band meanwhile: apply the change
+         * (modulo 2^32) rather than store a new value */
+        for (int x = 1; x < cols - 1; x++) {
+            uint32_t delta = q[x - 1] + q[x + 1] - 4 * q[x];
+            if (delta) {
+                #pragma omp atomic
+                row[x] += delta;
+            }
+        }
+    } else {
+        for (int x = 1; x < cols - 1; x++) {
+            row[x] = row[x] % 4
+                   + q[x - 1]   /* from left neighbor */
+                   + q[x + 1];  /* from right neighbor */
+        }
+    }
+    /* The rows across the band's cuts, and its own first and last rows,
+     * are written by two threads */
+    if (y - 1 > 0) {
+        hand_over(row - cols, q, cols, y - 1 <= y0);
+    }
+    if (y + 1 < rows - 1) {
+        hand_over(row + cols, q, cols, y + 1 >= y1 - 1);
+    }
+    return any;
+}
+
+long relax_atomic(uint32_t *sand, int rows, int cols) {
+    const int threads = band_max();
+    uint32_t *scratch = calloc((size_t)threads * cols, sizeof *scratch);
+    pass_flag *flags = malloc(threads * sizeof *flags);
+    if (!scratch || !flags) {
+        free(scratch);
+        free(flags);
+        return -1;
+    }
+    for (int t = 0; t < threads; t++) {
+        flags[t].clean = -1;
+    }
+
+    long epoch = 0;   /* passes that toppled anything, over all threads */
+    long passes = 0;  /* most such passes made by one thread */
+    #pragma omp parallel num_threads(threads) reduction(max:passes)
+    {
+        const int tid = band_index(), team = band_count();
+        uint32_t *q = scratch + (size_t)tid * cols;
+        int y0, y1;
+        band_rows(rows, tid, team, &y0, &y1);
+
+        long mine = 0;  /* passes of this thread that toppled anything */
+        for (;;) {
+            long start;
+            #pragma omp atomic read seq_cst
+            start = epoch;
+
+            uint32_t any = 0;
+            for (int y = y0; y < y1; y++) {
+                any |= topple_row(sand, rows, cols, y, y0, y1, q);
+            }
+            if (any) {
+                mine++;
+                #pragma omp atomic update seq_cst
+                epoch++;
+                continue;
+            }
+
+            #pragma omp atomic write seq_cst
+            flags[tid].clean = start;
+
+            /* Stop once every thread has found its band stable since the
+             * last pass that moved grains */
+            long now;
+            #pragma omp atomic read seq_cst
+            now = epoch;
+            bool done = start == now;
+            for (int t = 0; t < team && done; t++) {
+                if (t == tid) {
+                    continue;
+                }
+                long clean;
+                #pragma omp atomic read seq_cst
+                clean = flags[t].clean;
+                done = clean == now;
+            }
+            if (done) {
+                break;
+            }
+        }
+        passes = mine;
+    }
+
+    free(scratch);
+    free(flags);
+    return passes + 1;  /* and the pass that found the grid stable */
+}
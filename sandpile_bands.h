@@ -0,0 +1,70 @@
+#ifndef SANDPILE_BANDS_H
+#define SANDPILE_BANDS_H
+
+/*
+ * sandpile_bands.h
+ *
+ * Row-band decomposition shared by every parallel loop that touches whole
+ * grids: initialisation, narrowing, conversion to bit planes and the
+ * persistent synchronous sweep. Thread t of a team always gets the same
+ * band, so the pages of its rows are first touched, and therefore placed on
+ * a NUMA node, by the thread that relaxes them for the rest of the run.
+ *
+ * In the serial build there is a single band covering the whole grid.
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Band of the calling thread and number of bands in the current team */
+static inline int band_index(void) {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline int band_count(void) {
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+/* Bands in the largest team the next parallel region can get */
+static inline int band_max(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * band_rows
+ * ---------
+ * Interior rows [*y0, *y1) of band 'band' of 'bands' in a grid of 'rows'
+ * rows including the sink border. Bands differ in height by at most one.
+ */
+static inline void band_rows(int rows, int band, int bands, int *y0, int *y1) {
+    const long height = rows - 2;
+    *y0 = 1 + (int)(height * band / bands);
+    *y1 = 1 + (int)(height * (band + 1) / bands);
+}
+
+/* Rows [*y0, *y1) first touched by a band: its interior rows, plus the sink
+ * row above the first band and below the last */
+static inline void band_touch_rows(int rows, int band, int bands, int *y0, int *y1) {
+    band_rows(rows, band, bands, y0, y1);
+    if (band == 0) {
+        *y0 = 0;
+    }
+    if (band == bands - 1) {
+        *y1 = rows;
+    }
+}
+
+#endif /* SANDPILE_BANDS_H */
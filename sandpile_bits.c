@@ -0,0 +1,110 @@
+/*
+ * sandpile_bits.c
+ *
+ * Conversion between byte cells and bit planes, and the bit-sliced sweep.
+ * Column x of a row is bit x % 64 of word x / 64 of each plane.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_bits.h"
+
+/* Word 0 of the first plane of row y of a buffer */
+static inline uint64_t *bits_row(const bit_grid *b, uint64_t *buf, int y) {
+    return buf + (size_t)y * 3 * b->plane + 1;
+}
+
+int bits_init(bit_grid *b, const sandpile_grid *g) {
+    if (bits_alloc(b, g->rows, g->cols) != 0) {
+        return -1;
+    }
+    #pragma omp parallel
+    {
+        int y0, y1;
+        band_touch_rows(b->rows, band_index(), band_count(), &y0, &y1);
+        bits_load_rows(b, g, y0, y1);
+    }
+    return 0;
+}
+
+int bits_alloc(bit_grid *b, int rows, int cols) {
+    b->rows  = rows;
+    b->cols  = cols;
+    b->words = (cols + 63) / 64;
+    b->plane = b->words + 2;
+    size_t n = (size_t)b->rows * 3 * b->plane;
+    b->sand = malloc(n * sizeof *b->sand);
+    b->next = malloc(n * sizeof *b->next);
+    b->mask = calloc(b->words, sizeof *b->mask);
+    if (!b->sand || !b->next || !b->mask) {
+        bits_free(b);
+        return -1;
+    }
+
+    for (int x = 1; x < b->cols - 1; x++) {
+        b->mask[x / 64] |= (uint64_t)1 << (x % 64);
+    }
+    return 0;
+}
+
+void bits_load_rows(const bit_grid *b, const sandpile_grid *g, int y0, int y1) {
+    /* Zero both buffers (guard words, sink rows and padding bits stay zero
+     * for good), then set the bits of the interior cells */
+    size_t row_words = 3 * (size_t)b->plane;
+    memset(b->sand + y0 * row_words, 0, (y1 - y0) * row_words * sizeof *b->sand);
+    memset(b->next + y0 * row_words, 0, (y1 - y0) * row_words * sizeof *b->next);
+    for (int y = y0 > 1 ? y0 : 1; y < y1 && y < b->rows - 1; y++) {
+        uint64_t *row = bits_row(b, b->sand, y);
+        for (int x = 1; x < b->cols - 1; x++) {
+            uint32_t v = grid_get(g, (size_t)y * g->cols + x);
+            for (int p = 0; p < 3; p++) {
+                row[p * b->plane + x / 64] |= (uint64_t)((v >> p) & 1) << (x % 64);
+            }
+        }
+    }
+}
+
+void bits_free(bit_grid *b) {
+    free(b->sand);
+    free(b->next);
+    free(b->mask);
+    b->sand = b->next = b->mask = NULL;
+}
+
+int bits_relax(const bit_grid *b) {
+    int changed = 0;
+    #pragma omp parallel for reduction(|:changed)
+    for (int y = 1; y < b->rows - 1; y++) {
+        changed |= bits_relax_rows(b, y, y + 1);
+    }
+    return changed;
+}
+
+int bits_relax_rows(const bit_grid *b, int y0, int y1) {
+    int changed = 0;
+    for (int y = y0; y < y1; y++) {
+        changed |= relax_bits(bits_row(b, b->sand, y), bits_row(b, b->next, y),
+                              b->mask, b->plane, b->words);
+    }
+    return changed;
+}
+
+void bits_store(const bit_grid *b, sandpile_grid *g) {
+    #pragma omp parallel
+    {
+        int y0, y1;
+        band_touch_rows(b->rows, band_index(), band_count(), &y0, &y1);
+        for (int y = y0; y < y1; y++) {
+            const uint64_t *row = bits_row(b, b->sand, y);
+            for (int x = 0; x < b->cols; x++) {
+                uint32_t v = 0;
+                for (int p = 0; p < 3; p++) {
+                    v |= (uint32_t)((row[p * b->plane + x / 64] >> (x % 64)) & 1) << p;
+                }
+                cell_store(g->sand, g->type, (size_t)y * g->cols + x, v);
+            }
+        }
+    }
+}
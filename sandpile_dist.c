@@ -0,0 +1,739 @@
+/*
+ * sandpile_dist.c
+ *
+ * Block decomposition, ghost exchange and the distributed synchronous
+ * sweep. Ghost cells travel through per-direction pack buffers as plain
+ * bytes, so the same code serves every cell type. The exchange is
+ * non-blocking and overlaps the part of the first sweep of each block that
+ * does not read the ghost ring; built with OpenMP, the sweeps are shared by
+ * the threads of each rank.
+ *
+ * Rows are skipped while they and their neighbours are the same in both
+ * buffers: a sweep would only rewrite them with what the other buffer
+ * already holds. The cells swept per row are counted, and that profile
+ * decides where the cuts between the ranks' blocks move.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_dist.h"
+#include "sandpile_image.h"
+
+enum { DIR_N, DIR_S, DIR_W, DIR_E, DIR_NW, DIR_NE, DIR_SW, DIR_SE };
+
+/* Row and column offset of the neighbour in each direction, and the
+ * direction that points back from it */
+static const int dir_dy[DIST_DIRS]   = {-1, 1,  0, 0, -1, -1,  1, 1};
+static const int dir_dx[DIST_DIRS]   = { 0, 0, -1, 1, -1,  1, -1, 1};
+static const int dir_back[DIST_DIRS] = { 1, 0,  3, 2,  7,  6,  5, 4};
+
+/* A rectangle of local cells */
+typedef struct {
+    int y, x, h, w;
+} rect;
+
+static const rect no_rect = {0, 0, 0, 0};
+
+/* Owned cells next to the side facing direction 'dir' */
+static rect send_rect(const dist_grid *d, int dir) {
+    const int H = d->halo;
+    rect r;
+    r.y = dir_dy[dir] > 0 ? d->lh : H;
+    r.x = dir_dx[dir] > 0 ? d->lw : H;
+    r.h = dir_dy[dir] ? H : d->lh;
+    r.w = dir_dx[dir] ? H : d->lw;
+    return r;
+}
+
+/* Ghost cells filled by the neighbour in direction 'dir' */
+static rect recv_rect(const dist_grid *d, int dir) {
+    const int H = d->halo;
+    rect r;
+    r.y = dir_dy[dir] < 0 ? 0 : dir_dy[dir] > 0 ? H + d->lh : H;
+    r.x = dir_dx[dir] < 0 ? 0 : dir_dx[dir] > 0 ? H + d->lw : H;
+    r.h = dir_dy[dir] ? H : d->lh;
+    r.w = dir_dx[dir] ? H : d->lw;
+    return r;
+}
+
+/* Address of local cell (y, x) of a buffer of the block */
+static inline char *cell_at(const sandpile_grid *g, void *buf, int y, int x) {
+    return (char *)buf + ((size_t)y * g->cols + x) * cell_size(g->type);
+}
+
+/* Copy a rectangle of the current state to or from a contiguous buffer */
+static void pack(const sandpile_grid *g, rect r, void *buf) {
+    const size_t bytes = r.w * cell_size(g->type);
+    for (int i = 0; i < r.h; i++) {
+        memcpy((char *)buf + i * bytes, cell_at(g, g->sand, r.y + i, r.x), bytes);
+    }
+}
+
+static void unpack(const sandpile_grid *g, rect r, const void *buf) {
+    const size_t bytes = r.w * cell_size(g->type);
+    for (int i = 0; i < r.h; i++) {
+        memcpy(cell_at(g, g->sand, r.y + i, r.x), (const char *)buf + i * bytes, bytes);
+    }
+}
+
+/* Common part of two rectangles, empty if they do not overlap */
+static rect intersect(rect a, rect b) {
+    rect r;
+    r.y = a.y > b.y ? a.y : b.y;
+    r.x = a.x > b.x ? a.x : b.x;
+    r.h = (a.y + a.h < b.y + b.h ? a.y + a.h : b.y + b.h) - r.y;
+    r.w = (a.x + a.w < b.x + b.w ? a.x + a.w : b.x + b.w) - r.x;
+    if (r.h <= 0 || r.w <= 0) {
+        r.h = r.w = 0;
+    }
+    return r;
+}
+
+/* Global cells owned by the rank at Cartesian coordinates 'at' */
+static rect block_of(const int *row_cut, const int *col_cut, const int at[2]) {
+    rect r;
+    r.y = row_cut[at[0]];
+    r.x = col_cut[at[1]];
+    r.h = row_cut[at[0] + 1] - r.y;
+    r.w = col_cut[at[1] + 1] - r.x;
+    return r;
+}
+
+/* The same global cells in this rank's local coordinates */
+static rect to_local(const dist_grid *d, rect r) {
+    r.y += d->halo - d->y0;
+    r.x += d->halo - d->x0;
+    return r;
+}
+
+/* Cut n rows (or columns) evenly into 'parts' bands */
+static void even_cuts(int *cut, int parts, int n) {
+    for (int i = 0; i <= parts; i++) {
+        cut[i] = 1 + (int)((long)n * i / parts);
+    }
+}
+
+/* Release this rank's block, ghost buffers and row flags */
+static void layout_free(dist_grid *d) {
+    for (int dir = 0; dir < DIST_DIRS; dir++) {
+        free(d->sendbuf[dir]);
+        free(d->recvbuf[dir]);
+        d->sendbuf[dir] = d->recvbuf[dir] = NULL;
+    }
+    grid_free(&d->grid);
+    free(d->dirty);
+    free(d->ndirty);
+    free(d->fresh);
+    free(d->row_work);
+    d->dirty = d->ndirty = d->fresh = NULL;
+    d->row_work = NULL;
+}
+
+/**
+ * layout_alloc
+ * ------------
+ * Allocate this rank's block under the current cuts with both buffers
+ * zeroed, in cell type 'type', and mark every row dirty. Returns 0 on
+ * success, -1 if allocation fails.
+ */
+static int layout_alloc(dist_grid *d, cell_type type) {
+    const rect b = block_of(d->row_cut, d->col_cut, d->coords);
+    d->y0 = b.y;
+    d->x0 = b.x;
+    d->lh = b.h;
+    d->lw = b.w;
+
+    const int rows = d->lh + 2 * d->halo, cols = d->lw + 2 * d->halo;
+    if (grid_alloc(&d->grid, type, rows, cols, 2) != 0) {
+        d->grid.sand = d->grid.next = NULL;
+        return -1;
+    }
+    memset(d->grid.sand, 0, (size_t)rows * cols * cell_size(type));
+    memset(d->grid.next, 0, (size_t)rows * cols * cell_size(type));
+
+    d->dirty    = malloc(rows);
+    d->ndirty   = malloc(rows);
+    d->fresh    = calloc(rows, 1);
+    d->row_work = calloc(d->lh, sizeof *d->row_work);
+    if (!d->dirty || !d->ndirty || !d->fresh || !d->row_work) {
+        return -1;
+    }
+    memset(d->dirty, 1, rows);
+
+    /* Sized for 32-bit cells, so narrowing never needs new buffers */
+    for (int dir = 0; dir < DIST_DIRS; dir++) {
+        rect r = send_rect(d, dir);
+        size_t bytes = (size_t)r.h * r.w * sizeof(uint32_t);
+        d->sendbuf[dir] = malloc(bytes);
+        d->recvbuf[dir] = malloc(bytes);
+        if (!d->sendbuf[dir] || !d->recvbuf[dir]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int dist_init(dist_grid *d, MPI_Comm comm, int height, int width, int halo) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    d->dims[0] = d->dims[1] = 0;
+    MPI_Dims_create(size, 2, d->dims);
+    int periods[2] = {0, 0};
+    MPI_Cart_create(comm, 2, d->dims, periods, 1, &d->comm);
+    MPI_Comm_rank(d->comm, &d->rank);
+    MPI_Cart_coords(d->comm, d->rank, 2, d->coords);
+
+    for (int dir = 0; dir < DIST_DIRS; dir++) {
+        int cy = d->coords[0] + dir_dy[dir], cx = d->coords[1] + dir_dx[dir];
+        d->neighbour[dir] = MPI_PROC_NULL;
+        if (cy >= 0 && cy < d->dims[0] && cx >= 0 && cx < d->dims[1]) {
+            int at[2] = {cy, cx};
+            MPI_Cart_rank(d->comm, at, &d->neighbour[dir]);
+        }
+        d->sendbuf[dir] = d->recvbuf[dir] = NULL;
+    }
+
+    d->height = height;
+    d->width = width;
+    d->halo = halo;
+    d->rebalance = DIST_REBALANCE_SWEEPS;
+    d->rebalances = 0;
+    d->grid.sand = d->grid.next = NULL;
+    d->dirty = d->ndirty = d->fresh = NULL;
+    d->row_work = NULL;
+
+    /* Blocks start out differing in size by at most one row or column */
+    d->row_cut = malloc((d->dims[0] + 1) * sizeof *d->row_cut);
+    d->col_cut = malloc((d->dims[1] + 1) * sizeof *d->col_cut);
+    if (!d->row_cut || !d->col_cut) {
+        return -1;
+    }
+    even_cuts(d->row_cut, d->dims[0], height);
+    even_cuts(d->col_cut, d->dims[1], width);
+    if (height < d->dims[0] * d->halo || width < d->dims[1] * d->halo) {
+        errno = EINVAL;  /* blocks thinner than the ghost ring */
+        return -1;
+    }
+    return layout_alloc(d, CELL_U32);
+}
+
+void dist_free(dist_grid *d) {
+    layout_free(d);
+    free(d->row_cut);
+    free(d->col_cut);
+    MPI_Comm_free(&d->comm);
+}
+
+long dist_index(const dist_grid *d, int gy, int gx) {
+    int ly = gy - d->y0, lx = gx - d->x0;
+    if (ly < 0 || ly >= d->lh || lx < 0 || lx >= d->lw) {
+        return -1;
+    }
+    return (long)(ly + d->halo) * d->grid.cols + (lx + d->halo);
+}
+
+int dist_narrow(dist_grid *d) {
+    uint32_t max = grid_bound(&d->grid);
+    MPI_Allreduce(MPI_IN_PLACE, &max, 1, MPI_UINT32_T, MPI_MAX, d->comm);
+    cell_type type = cell_type_for_max(max);
+    if (type >= d->grid.type) {
+        return 0;
+    }
+    /* Every rank must switch, or the ghost exchange would mix cell sizes */
+    int ok = grid_repack(&d->grid, type) == 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, d->comm);
+    return ok ? 1 : -1;
+}
+
+/* Directions exchanged: the 5-point stencil needs no corners for a ring
+ * one cell wide */
+static inline int dist_dirs(const dist_grid *d) {
+    return d->halo > 1 ? DIST_DIRS : 4;
+}
+
+/**
+ * exchange_begin
+ * --------------
+ * Start filling the ghost ring of the current state from the neighbours'
+ * blocks: post the receives, pack the boundary cells and post the sends.
+ * Returns the number of requests stored in 'req'. The current state must not
+ * be written until exchange_end.
+ */
+static int exchange_begin(dist_grid *d, MPI_Request *req) {
+    int n = 0;
+    const size_t size = cell_size(d->grid.type);
+    for (int dir = 0; dir < dist_dirs(d); dir++) {
+        if (d->neighbour[dir] != MPI_PROC_NULL) {
+            rect r = recv_rect(d, dir);
+            MPI_Irecv(d->recvbuf[dir], (int)(r.h * r.w * size), MPI_BYTE,
+                      d->neighbour[dir], dir_back[dir], d->comm, &req[n++]);
+        }
+    }
+    for (int dir = 0; dir < dist_dirs(d); dir++) {
+        if (d->neighbour[dir] != MPI_PROC_NULL) {
+            rect r = send_rect(d, dir);
+            pack(&d->grid, r, d->sendbuf[dir]);
+            MPI_Isend(d->sendbuf[dir], (int)(r.h * r.w * size), MPI_BYTE,
+                      d->neighbour[dir], dir, d->comm, &req[n++]);
+        }
+    }
+    return n;
+}
+
+/* Wait for the exchange and copy the received cells into the ghost ring,
+ * marking in 'fresh' the rows where they differ from the other buffer */
+static void exchange_end(dist_grid *d, MPI_Request *req, int n) {
+    const sandpile_grid *g = &d->grid;
+    const size_t size = cell_size(g->type);
+    MPI_Waitall(n, req, MPI_STATUSES_IGNORE);
+    memset(d->fresh, 0, g->rows);
+    for (int dir = 0; dir < dist_dirs(d); dir++) {
+        if (d->neighbour[dir] != MPI_PROC_NULL) {
+            rect r = recv_rect(d, dir);
+            unpack(g, r, d->recvbuf[dir]);
+            for (int y = r.y; y < r.y + r.h; y++) {
+                if (memcmp(cell_at(g, g->sand, y, r.x), cell_at(g, g->next, y, r.x),
+                           r.w * size) != 0) {
+                    d->fresh[y] = 1;
+                }
+            }
+        }
+    }
+}
+
+/* Cells swept by a sweep that reaches 'reach' ghost cells beyond the owned
+ * block, on the sides that have a neighbour (beyond the others lies the
+ * sink). A negative reach shrinks the block on those sides instead. */
+static rect sweep_rect(const dist_grid *d, int reach) {
+    const int top    = d->neighbour[DIR_N] != MPI_PROC_NULL ? reach : 0;
+    const int bottom = d->neighbour[DIR_S] != MPI_PROC_NULL ? reach : 0;
+    const int left   = d->neighbour[DIR_W] != MPI_PROC_NULL ? reach : 0;
+    const int right  = d->neighbour[DIR_E] != MPI_PROC_NULL ? reach : 0;
+    rect r;
+    r.y = d->halo - top;
+    r.x = d->halo - left;
+    r.h = top + d->lh + bottom;
+    r.w = left + d->lw + right;
+    if (r.h < 0 || r.w < 0) {
+        r.h = r.w = 0;
+    }
+    return r;
+}
+
+/* Sweep columns [x0, x1) of local row y, setting *any if a cell changed;
+ * returns 1 if an owned cell changed. Changes in ghost cells are their
+ * owners' to report. */
+static int sweep_span(const dist_grid *d, int y, int x0, int x1, int *any) {
+    const int H = d->halo;
+    if (x0 >= x1) {
+        return 0;
+    }
+    if (y < H || y >= H + d->lh) {
+        *any |= grid_relax_span(&d->grid, y, x0, x1 - x0);
+        return 0;
+    }
+    const int lo = x0 > H ? x0 : H;
+    const int hi = x1 < H + d->lw ? x1 : H + d->lw;
+    if (x0 < lo) {
+        *any |= grid_relax_span(&d->grid, y, x0, lo - x0);
+    }
+    if (hi < x1) {
+        *any |= grid_relax_span(&d->grid, y, hi, x1 - hi);
+    }
+    int changed = 0;
+    if (lo < hi) {
+        changed = grid_relax_span(&d->grid, y, lo, hi - lo);
+        d->row_work[y - H] += hi - lo;
+        *any |= changed;
+    }
+    return changed;
+}
+
+/* Sweep the cells of row y in 'outer' but not in 'inner' (which may be
+ * empty); as sweep_span */
+static int frame_row(const dist_grid *d, int y, rect outer, rect inner, int *any) {
+    if (y < inner.y || y >= inner.y + inner.h) {
+        return sweep_span(d, y, outer.x, outer.x + outer.w, any);
+    }
+    return sweep_span(d, y, outer.x, inner.x, any) |
+           sweep_span(d, y, inner.x + inner.w, outer.x + outer.w, any);
+}
+
+/* A row needs sweeping unless it and the rows next to it are the same in
+ * both buffers */
+static inline bool row_active(const unsigned char *dirty, int y) {
+    return dirty[y - 1] | dirty[y] | dirty[y + 1];
+}
+
+/**
+ * sweep_block
+ * -----------
+ * Exchange the ghost ring and perform the 'halo' sweeps of a block, the
+ * first reaching halo - 1 ghost cells out and each later one a cell less.
+ * Returns a mask whose bit s is set if sweep s + 1 changed an owned cell.
+ *
+ * The owned cells one step in from every neighbouring side do not read the
+ * ghost ring, so the first sweep covers them while the messages are in
+ * flight and the frame around them once the ring is filled. With several
+ * threads the rows are shared out in one parallel region and MPI is called
+ * from the master thread only (MPI_THREAD_FUNNELED): it runs the whole
+ * exchange while the other threads sweep the inner rows, then joins them.
+ * A lone thread starts the exchange, sweeps the inner rows and then waits.
+ *
+ * 'dirty' marks the rows that changed in the previous sweep and 'fresh' the
+ * rows whose ghost cells the exchange changed; the inner rows never read
+ * the ghost ring, so only the frame waits for 'fresh'.
+ */
+static uint64_t sweep_block(dist_grid *d) {
+    MPI_Request req[2 * DIST_DIRS];
+    int n = 0;
+    uint64_t mask = 0;
+    const rect inner = sweep_rect(d, -1);
+
+    #pragma omp parallel
+    {
+        const bool funnel = band_count() > 1;
+        int changed = 0;
+
+        #pragma omp master
+        {
+            n = exchange_begin(d, req);
+            if (funnel) {
+                exchange_end(d, req, n);
+            }
+        }
+        #pragma omp for schedule(dynamic, 4) nowait
+        for (int y = inner.y; y < inner.y + inner.h; y++) {
+            int any = 0;
+            if (row_active(d->dirty, y)) {
+                changed |= sweep_span(d, y, inner.x, inner.x + inner.w, &any);
+            }
+            d->ndirty[y] = any;
+        }
+        #pragma omp master
+        {
+            if (!funnel) {
+                exchange_end(d, req, n);
+            }
+        }
+        /* The ghost ring is filled from here on */
+        #pragma omp barrier
+
+        for (int s = 0; s < d->halo; s++) {
+            const rect outer = sweep_rect(d, d->halo - 1 - s);
+            const rect done = s == 0 ? inner : no_rect;
+            #pragma omp for schedule(static)
+            for (int y = 0; y < d->grid.rows; y++) {
+                if (y < outer.y || y >= outer.y + outer.h) {
+                    d->ndirty[y] = 0;
+                    continue;
+                }
+                int any = 0;
+                if (row_active(d->dirty, y) || (s == 0 && row_active(d->fresh, y))) {
+                    changed |= frame_row(d, y, outer, done, &any);
+                }
+                if (y >= done.y && y < done.y + done.h) {
+                    d->ndirty[y] |= any;
+                } else {
+                    d->ndirty[y] = any;
+                }
+            }
+            if (changed) {
+                #pragma omp atomic
+                mask |= (uint64_t)1 << s;
+            }
+            changed = 0;
+            #pragma omp single
+            {
+                unsigned char *t = d->dirty;
+                d->dirty = d->ndirty;
+                d->ndirty = t;
+                grid_swap(&d->grid);
+            }
+        }
+    }
+    return mask;
+}
+
+/**
+ * balance_cuts
+ * ------------
+ * Cut n rows (or columns) with work profile 'work' into 'parts' bands of
+ * about equal work, each at least 'least' wide.
+ */
+static void balance_cuts(int *cut, int parts, const double *work, int n, int least) {
+    double total = 0;
+    for (int i = 0; i < n; i++) {
+        total += work[i];
+    }
+    cut[0] = 1;
+    cut[parts] = n + 1;
+    double sum = 0;  /* work of rows [0, i) */
+    int i = 0;
+    for (int p = 1; p < parts; p++) {
+        const double target = total * p / parts;
+        while (i < n && sum + work[i] / 2 < target) {
+            sum += work[i++];
+        }
+        int at = 1 + i;
+        const int lo = cut[p - 1] + least, hi = n + 1 - (parts - p) * least;
+        at = at < lo ? lo : at > hi ? hi : at;
+        while (i < at - 1) {
+            sum += work[i++];
+        }
+        while (i > at - 1) {
+            sum -= work[--i];
+        }
+        cut[p] = at;
+    }
+}
+
+/**
+ * migrate
+ * -------
+ * Move every rank to its block under the new cuts, which 'd' takes over
+ * (freeing the old ones), sending each cell from its old owner to its new
+ * one. Both buffers of the
+ * new block hold the current state. Collective. Returns 0 on success, -1 if
+ * allocation fails.
+ */
+static int migrate(dist_grid *d, int *row_cut, int *col_cut) {
+    int size;
+    MPI_Comm_size(d->comm, &size);
+    const cell_type type = d->grid.type;
+    const size_t cs = cell_size(type);
+    const rect old_own = block_of(d->row_cut, d->col_cut, d->coords);
+    const rect new_own = block_of(row_cut, col_cut, d->coords);
+
+    int *counts = malloc(4 * (size_t)size * sizeof *counts);
+    char *out = malloc((size_t)old_own.h * old_own.w * cs);
+    char *in = malloc((size_t)new_own.h * new_own.w * cs);
+    int ok = counts && out && in;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, d->comm);
+    if (!ok) {
+        free(counts);
+        free(out);
+        free(in);
+        return -1;
+    }
+
+    /* Rank r gets the part of the old block inside its new block, and sends
+     * the part of its old block inside this rank's new block */
+    int *send_n = counts, *send_at = counts + size;
+    int *recv_n = counts + 2 * size, *recv_at = counts + 3 * size;
+    int sent = 0, received = 0;
+    for (int r = 0; r < size; r++) {
+        int at[2];
+        MPI_Cart_coords(d->comm, r, 2, at);
+        rect give = intersect(old_own, block_of(row_cut, col_cut, at));
+        rect take = intersect(block_of(d->row_cut, d->col_cut, at), new_own);
+        send_n[r] = (int)(give.h * give.w * cs);
+        recv_n[r] = (int)(take.h * take.w * cs);
+        send_at[r] = sent;
+        recv_at[r] = received;
+        if (give.h) {
+            pack(&d->grid, to_local(d, give), out + sent);
+        }
+        sent += send_n[r];
+        received += recv_n[r];
+    }
+    MPI_Alltoallv(out, send_n, send_at, MPI_BYTE, in, recv_n, recv_at, MPI_BYTE, d->comm);
+
+    /* Rebuild the block under the new cuts, keeping the old ones to find
+     * where the received cells came from */
+    int *old_rows = d->row_cut, *old_cols = d->col_cut;
+    layout_free(d);
+    d->row_cut = row_cut;
+    d->col_cut = col_cut;
+    ok = layout_alloc(d, type) == 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, d->comm);
+    if (ok) {
+        for (int r = 0; r < size; r++) {
+            int at[2];
+            MPI_Cart_coords(d->comm, r, 2, at);
+            rect take = intersect(block_of(old_rows, old_cols, at), new_own);
+            if (take.h) {
+                unpack(&d->grid, to_local(d, take), in + recv_at[r]);
+            }
+        }
+        memcpy(d->grid.next, d->grid.sand, (size_t)d->grid.rows * d->grid.cols * cs);
+    }
+    free(old_rows);
+    free(old_cols);
+    free(counts);
+    free(out);
+    free(in);
+    return ok ? 0 : -1;
+}
+
+/**
+ * rebalance
+ * ---------
+ * If the cells swept by the busiest rank since the last call exceed the
+ * mean by more than DIST_IMBALANCE, move the cuts so that every band of
+ * ranks gets about the same share of the swept rows and of the swept
+ * columns, and migrate the cells. Rows are profiled exactly; as rows are
+ * skipped whole, a rank's columns all count its mean work per column.
+ * Collective. Returns 1 if the blocks moved, 0 if not, -1 if allocation
+ * fails.
+ */
+static int rebalance(dist_grid *d) {
+    int size;
+    MPI_Comm_size(d->comm, &size);
+    long work = 0, total, most;
+    for (int i = 0; i < d->lh; i++) {
+        work += d->row_work[i];
+    }
+    MPI_Allreduce(&work, &total, 1, MPI_LONG, MPI_SUM, d->comm);
+    MPI_Allreduce(&work, &most, 1, MPI_LONG, MPI_MAX, d->comm);
+    if (total == 0 || (double)most * size <= DIST_IMBALANCE * total) {
+        memset(d->row_work, 0, d->lh * sizeof *d->row_work);
+        return 0;
+    }
+
+    double *profile = calloc((size_t)d->height + d->width, sizeof *profile);
+    int *row_cut = malloc((d->dims[0] + 1) * sizeof *row_cut);
+    int *col_cut = malloc((d->dims[1] + 1) * sizeof *col_cut);
+    int ok = profile && row_cut && col_cut;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, d->comm);
+    if (!ok) {
+        free(profile);
+        free(row_cut);
+        free(col_cut);
+        return -1;
+    }
+    double *rows = profile, *cols = profile + d->height;
+    for (int i = 0; i < d->lh; i++) {
+        rows[d->y0 - 1 + i] = (double)d->row_work[i];
+    }
+    for (int j = 0; j < d->lw; j++) {
+        cols[d->x0 - 1 + j] = (double)work / d->lw;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, profile, d->height + d->width, MPI_DOUBLE, MPI_SUM, d->comm);
+    balance_cuts(row_cut, d->dims[0], rows, d->height, d->halo);
+    balance_cuts(col_cut, d->dims[1], cols, d->width, d->halo);
+    free(profile);
+    memset(d->row_work, 0, d->lh * sizeof *d->row_work);
+
+    if (memcmp(row_cut, d->row_cut, (d->dims[0] + 1) * sizeof *row_cut) == 0 &&
+        memcmp(col_cut, d->col_cut, (d->dims[1] + 1) * sizeof *col_cut) == 0) {
+        free(row_cut);
+        free(col_cut);
+        return 0;
+    }
+    if (migrate(d, row_cut, col_cut) != 0) {
+        return -1;
+    }
+    d->rebalances++;
+    return 1;
+}
+
+long dist_relax(dist_grid *d) {
+    long sweeps = 0, narrow_at = NARROW_INTERVAL, rebalance_at = d->rebalance;
+    long last = 0;              /* last sweep that changed an owned cell */
+    long checked = 0, latest;   /* in-flight check: sweeps done, MAX of 'last' */
+    long posted;                /* 'last' as sent with it */
+    MPI_Request check = MPI_REQUEST_NULL;
+    int blocks = 0, every = 1;  /* blocks since the last check, and interval */
+    const int max_every = d->halo < DIST_CHECK_SWEEPS ? DIST_CHECK_SWEEPS / d->halo : 1;
+
+    for (;;) {
+        uint64_t mask = sweep_block(d);
+        for (int s = 0; s < d->halo; s++) {
+            sweeps++;
+            if (mask >> s & 1) {
+                last = sweeps;
+            }
+        }
+
+        if (++blocks == every) {
+            /* Read the previous check, started 'every' blocks ago: if the
+             * latest change came before it, the sweep after that change was
+             * stable everywhere and every sweep since has been a no-op */
+            if (check != MPI_REQUEST_NULL) {
+                MPI_Wait(&check, MPI_STATUS_IGNORE);
+                if (latest < checked) {
+                    return latest + 1;
+                }
+            }
+            posted = last;
+            checked = sweeps;
+            MPI_Iallreduce(&posted, &latest, 1, MPI_LONG, MPI_MAX, d->comm, &check);
+            blocks = 0;
+            every = every * 2 < max_every ? every * 2 : max_every;
+        }
+
+        /* Narrow the cells as heights drop (centre-pile runs) */
+        if (sweeps >= narrow_at) {
+            narrow_at = sweeps + NARROW_INTERVAL;
+            int narrowed = dist_narrow(d);
+            if (narrowed < 0) {
+                return -1;
+            }
+            if (narrowed && d->rank == 0) {
+                fprintf(stderr, "[MPI] Cell type: %s after %ld sweeps\n",
+                        cell_type_name(d->grid.type), sweeps);
+            }
+        }
+
+        /* Move the cuts after the work (centre-pile runs) */
+        if (d->rebalance > 0 && sweeps >= rebalance_at) {
+            rebalance_at = sweeps + d->rebalance;
+            if (rebalance(d) < 0) {
+                return -1;
+            }
+        }
+    }
+}
+
+int dist_write_ppm(const dist_grid *d, const char *path) {
+    char header[64];
+    int header_len = snprintf(header, sizeof header, "P6\n%d %d\n255\n", d->width, d->height);
+
+    unsigned char *rgb = malloc((size_t)d->lh * d->lw * 3);
+    int ok = rgb != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, d->comm);
+    if (!ok) {
+        free(rgb);
+        return -1;
+    }
+    for (int y = 0; y < d->lh; y++) {
+        image_encode_row(&d->grid, y + d->halo, d->halo, d->lw, rgb + (size_t)y * d->lw * 3);
+    }
+
+    /* Each block is a subarray of the image's rows of width pixels */
+    MPI_File fh;
+    if (MPI_File_open(d->comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        free(rgb);
+        return -1;
+    }
+    MPI_File_set_size(fh, 0);
+    if (d->rank == 0) {
+        MPI_File_write_at(fh, 0, header, header_len, MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+    /* Counted in pixels and block rows rather than bytes, so that a block
+     * of more than INT_MAX bytes still has int counts */
+    MPI_Datatype pixel, row, view;
+    MPI_Type_contiguous(3, MPI_BYTE, &pixel);
+    MPI_Type_contiguous(d->lw, pixel, &row);
+    MPI_Type_commit(&row);
+    int sizes[2]  = {d->height, d->width};
+    int block[2]  = {d->lh, d->lw};
+    int starts[2] = {d->y0 - 1, d->x0 - 1};
+    MPI_Type_create_subarray(2, sizes, block, starts, MPI_ORDER_C, pixel, &view);
+    MPI_Type_commit(&view);
+    MPI_File_set_view(fh, header_len, MPI_BYTE, view, "native", MPI_INFO_NULL);
+    int err = MPI_File_write_all(fh, rgb, d->lh, row, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    MPI_Type_free(&view);
+    MPI_Type_free(&row);
+    MPI_Type_free(&pixel);
+    free(rgb);
+    return err == MPI_SUCCESS ? 0 : -1;
+}
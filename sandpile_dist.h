@@ -0,0 +1,133 @@
+#ifndef SANDPILE_DIST_H
+#define SANDPILE_DIST_H
+
+/*
+ * sandpile_dist.h
+ *
+ * Distributed-memory grid for the MPI engine. The height x width interior
+ * is split over a 2D Cartesian grid of ranks; each rank stores its block of
+ * owned cells surrounded by a ring of ghost cells holding its neighbours'
+ * boundary cells (or the sink, at the edge of the global grid). The sweep
+ * count and final state are those of the serial engine.
+ *
+ * With a ghost ring of width H ("deep halo") the ranks exchange H rows and
+ * columns, corners included, once per H sweeps. Sweep s of such a block
+ * also recomputes the ghost cells within H - s of the owned block, so each
+ * sweep still has correct inputs for its owned cells: the ring shrinks by
+ * one cell per sweep. That is H times fewer messages for a little
+ * redundant work.
+ *
+ * Convergence is not checked every sweep. Each rank remembers the last sweep
+ * that changed one of its cells, and every so many blocks a non-blocking MAX
+ * reduction of that sweep number is started; it completes while the next
+ * blocks are swept and is read at the following check. If the latest change
+ * anywhere came before the check was started, the sweep after it was stable
+ * and gives the exact iteration count. The sweeps done in the meantime are
+ * no-ops on a stable grid, so nothing needs to be rolled back. The check
+ * interval starts at one block and doubles up to DIST_CHECK_SWEEPS.
+ *
+ * A row is not swept while it and the rows next to it are the same in both
+ * buffers, so the work follows the active region. Every so many sweeps the
+ * ranks compare the cells they swept; if the busiest is well above the
+ * mean, the cuts between the bands of ranks move to even out the measured
+ * row and column work, and the cells migrate to their new owners.
+ *
+ * The exchange is non-blocking: the owned cells that do not touch the ghost
+ * ring are swept while the messages are in flight, and only the strip along
+ * the block's edges waits for them.
+ *
+ * Built with OpenMP, each rank is a team of threads sharing the rows of its
+ * block (one rank per NUMA domain rather than per core means fewer, larger
+ * halos). Only the master thread calls MPI, so MPI_THREAD_FUNNELED suffices:
+ * it drives the exchange while the other threads start on the inner rows.
+ */
+
+#include <mpi.h>
+
+#include "sandpile_grid.h"
+
+/* Neighbour directions: north, south, west, east and the four diagonals,
+ * which only deep halos need */
+#define DIST_DIRS 8
+
+/* Widest ghost ring: the sweeps of a block are recorded in 64 bits */
+#define DIST_MAX_HALO 64
+
+/* Longest interval between convergence checks, in sweeps: bounds the wasted
+ * sweeps after the grid has become stable */
+#define DIST_CHECK_SWEEPS 64
+
+/* Default interval between load checks, in sweeps, and the ratio of the
+ * busiest rank's work to the mean above which the blocks are moved */
+#define DIST_REBALANCE_SWEEPS 512
+#define DIST_IMBALANCE 1.2
+
+typedef struct {
+    MPI_Comm      comm;          /* 2D Cartesian communicator */
+    int           rank;
+    int           dims[2];       /* ranks per column and per row of the grid */
+    int           coords[2];     /* position of this rank among them */
+    int           neighbour[DIST_DIRS];  /* ranks, or MPI_PROC_NULL at the edge */
+    int           height;        /* global interior size */
+    int           width;
+    int          *row_cut;       /* first global row of each band of ranks, and height + 1 */
+    int          *col_cut;       /* the same for the columns */
+    int           y0, x0;        /* global position of the first owned cell */
+    int           lh, lw;        /* owned rows and columns */
+    int           halo;          /* ghost ring width */
+    sandpile_grid grid;          /* owned block plus ghost ring, double buffered */
+    void         *sendbuf[DIST_DIRS];
+    void         *recvbuf[DIST_DIRS];
+    unsigned char *dirty;        /* per local row: differs between the buffers */
+    unsigned char *ndirty;       /* the same, being built by the current sweep */
+    unsigned char *fresh;        /* per local row: ghost cells changed by the exchange */
+    long         *row_work;      /* owned cells swept per owned row since the last check */
+    long          rebalance;     /* sweeps between load checks, 0 for never */
+    int           rebalances;    /* times the blocks were moved */
+} dist_grid;
+
+/**
+ * dist_init
+ * ---------
+ * Split a height x width interior over the ranks of 'comm' and allocate
+ * this rank's block as zeroed 32-bit cells with a ghost ring 'halo' cells
+ * wide (1 to DIST_MAX_HALO). Returns 0 on success, or -1 with errno set to
+ * EINVAL if the blocks would be thinner than the ring and to ENOMEM if
+ * allocation fails.
+ */
+int dist_init(dist_grid *d, MPI_Comm comm, int height, int width, int halo);
+
+/* Release the block and the Cartesian communicator */
+void dist_free(dist_grid *d);
+
+/* Local linear index of global cell (gy, gx), or -1 if not owned here */
+long dist_index(const dist_grid *d, int gy, int gx);
+
+/**
+ * dist_narrow
+ * -----------
+ * Repack every rank's block into the narrowest cell type that holds the
+ * largest height of the whole grid. Collective. Returns 1 if the type
+ * changed, 0 otherwise.
+ */
+int dist_narrow(dist_grid *d);
+
+/**
+ * dist_relax
+ * ----------
+ * Relax the distributed grid to its stable state with synchronous sweeps.
+ * Collective. Returns the number of sweeps the serial engine takes, or -1 on
+ * allocation failure.
+ */
+long dist_relax(dist_grid *d);
+
+/**
+ * dist_write_ppm
+ * --------------
+ * Write the final state as a binary PPM with the serial engine's colours,
+ * each rank writing its own block through MPI-IO. Collective. Returns 0 on
+ * success, -1 if the file cannot be written.
+ */
+int dist_write_ppm(const dist_grid *d, const char *path);
+
+#endif /* SANDPILE_DIST_H */
@@ -0,0 +1,76 @@
+#ifndef SANDPILE_ENGINE_H
+#define SANDPILE_ENGINE_H
+
+/*
+ * sandpile_engine.h
+ *
+ * Alternative relaxation engines. The synchronous sweep lives in the
+ * drivers; the engines declared here reach the same final stable state
+ * through a different toppling order, which the Abelian property allows.
+ * Each returns the number of sweeps it performed, or -1 on allocation
+ * failure.
+ */
+
+#include <stdint.h>
+
+/* Drop the grains that fell into the sink border of a rows x cols grid, for
+ * the engines that topple in place */
+static inline void clear_sink(uint32_t *sand, int rows, int cols) {
+    for (int x = 0; x < cols; x++) {
+        sand[x] = 0;
+        sand[(long)(rows - 1) * cols + x] = 0;
+    }
+    for (int y = 1; y < rows - 1; y++) {
+        sand[(long)y * cols] = 0;
+        sand[(long)y * cols + cols - 1] = 0;
+    }
+}
+
+/**
+ * relax_async
+ * -----------
+ * Relax the grid in place with asynchronous (Gauss-Seidel) toppling: each
+ * unstable cell hands v / 4 grains to its four neighbours as soon as its row
+ * is visited, so grains can travel down the grid within a single sweep and
+ * no second buffer is needed. Sweeps until one finds no unstable cell.
+ * 'sand' is a rows x cols grid whose border is the sink. Returns -1 if the
+ * scratch row cannot be allocated.
+ */
+long relax_async(uint32_t *sand, int rows, int cols);
+
+/**
+ * relax_worklist
+ * --------------
+ * Relax the grid in place by visiting only unstable cells: cells with 4 or
+ * more grains are kept on a de-duplicated stack, each visit topples a cell
+ * v / 4 times at once, and neighbours that reach 4 are pushed. Suited to
+ * sparse activity such as a centre pile or a grain added to a stable grid.
+ * Returns the number of cell visits rather than sweeps, or -1 if the
+ * worklist cannot be allocated.
+ */
+long relax_worklist(uint32_t *sand, int rows, int cols);
+
+/**
+ * relax_redblack
+ * --------------
+ * Relax the grid in place with OpenMP, alternating between updating all
+ * red cells ((x + y) even) and all black cells in parallel. A cell of one
+ * colour only has neighbours of the other, so no two threads write the same
+ * cell and no second buffer is needed. Returns the number of red+black
+ * sweeps. 'sand' is a rows x cols grid whose border is the sink.
+ */
+long relax_redblack(uint32_t *sand, int rows, int cols);
+
+/**
+ * relax_atomic
+ * ------------
+ * Relax the grid in place with OpenMP and no barriers: each thread topples
+ * its own row band pass after pass, hands grains across the band cuts with
+ * atomic adds, and stops once a termination check finds every band stable.
+ * Returns the most passes in which one thread toppled anything, plus the
+ * final stable pass. 'sand' is a rows x cols grid whose border is the sink.
+ * Returns -1 if the per-thread scratch cannot be allocated.
+ */
+long relax_atomic(uint32_t *sand, int rows, int cols);
+
+#endif /* SANDPILE_ENGINE_H */
@@ -0,0 +1,123 @@
+/*
+ * sandpile_fold.c
+ *
+ * Quadrant and octant folding of symmetric grids. A full grid of height x
+ * width interior cells folds into its top-left (height + 1) / 2 x
+ * (width + 1) / 2 interior cells; with an odd size the centre row or column
+ * is its own mirror image.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "sandpile_fold.h"
+
+const char *symmetry_name(symmetry sym) {
+    switch (sym) {
+        case SYMMETRY_D2: return "D2 (quadrant)";
+        case SYMMETRY_D4: return "D4 (octant)";
+        default:          return "none";
+    }
+}
+
+symmetry symmetry_detect(const sandpile_grid *g) {
+    const int rows = g->rows, cols = g->cols;
+    bool d4 = rows == cols;
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) {
+            uint32_t v = grid_get(g, (size_t)y * cols + x);
+            if (v != grid_get(g, (size_t)(rows - 1 - y) * cols + x)
+             || v != grid_get(g, (size_t)y * cols + (cols - 1 - x))) {
+                return SYMMETRY_NONE;
+            }
+            if (d4 && v != grid_get(g, (size_t)x * cols + y)) {
+                d4 = false;
+            }
+        }
+    }
+    return d4 ? SYMMETRY_D4 : SYMMETRY_D2;
+}
+
+/* Folded coordinate of row or column i of a full grid with n interior cells */
+static inline int fold_index(int i, int n) {
+    return i <= (n + 1) / 2 ? i : n + 1 - i;
+}
+
+/* Address of cell (y, x) of a buffer of g's shape and type */
+static inline char *cell_at(const sandpile_grid *g, void *buf, int y, int x) {
+    return (char *)buf + ((size_t)y * g->cols + x) * cell_size(g->type);
+}
+
+int fold_init(fold_grid *f, const sandpile_grid *g, symmetry sym) {
+    const int height = g->rows - 2, width = g->cols - 2;
+    const int rows = (height + 1) / 2 + 2, cols = (width + 1) / 2 + 2;
+    if (grid_alloc(&f->grid, g->type, rows, cols, 2) != 0) {
+        return -1;
+    }
+    f->sym = sym;
+    f->height = height;
+    f->width = width;
+
+    /* The full grid is symmetric, so its cells just past the quadrant are
+     * already the mirrored ghost cells */
+    const size_t bytes = cols * cell_size(g->type);
+    for (int y = 0; y < rows; y++) {
+        memcpy(cell_at(&f->grid, f->grid.sand, y, 0), cell_at(g, g->sand, y, 0), bytes);
+        memcpy(cell_at(&f->grid, f->grid.next, y, 0), cell_at(g, g->sand, y, 0), bytes);
+    }
+    return 0;
+}
+
+void fold_free(fold_grid *f) {
+    grid_free(&f->grid);
+}
+
+int fold_relax(fold_grid *f) {
+    const sandpile_grid *g = &f->grid;
+    const int qh = g->rows - 2, qw = g->cols - 2;
+    const size_t size = cell_size(g->type);
+    const bool octant = f->sym == SYMMETRY_D4;
+
+    /* Cells just below the diagonal are the transposes of those above it */
+    if (octant) {
+        for (int y = 2; y <= qh; y++) {
+            memcpy(cell_at(g, g->sand, y, y - 1), cell_at(g, g->sand, y - 1, y), size);
+        }
+    }
+    /* Right and bottom ghosts mirror the last column and row of the other
+     * half: the border cell itself for an even size, its neighbour for odd */
+    for (int y = 1; y <= qh; y++) {
+        memcpy(cell_at(g, g->sand, y, qw + 1), cell_at(g, g->sand, y, f->width - qw), size);
+    }
+    memcpy(cell_at(g, g->sand, qh + 1, 1), cell_at(g, g->sand, f->height - qh, 1), qw * size);
+
+    int changed = 0;
+    #pragma omp parallel for schedule(dynamic, 16) reduction(|:changed)
+    for (int y = 1; y <= qh; y++) {
+        int x = octant ? y : 1;  /* the octant row starts on the diagonal */
+        changed |= grid_relax_span(g, y, x, qw - x + 1);
+    }
+    return changed;
+}
+
+int fold_unfold(const fold_grid *f, sandpile_grid *g) {
+    const int rows = f->height + 2, cols = f->width + 2;
+    if (grid_alloc(g, f->grid.type, rows, cols, 1) != 0) {
+        return -1;
+    }
+    const size_t size = cell_size(g->type);
+    #pragma omp parallel for
+    for (int y = 0; y < rows; y++) {
+        int fy = fold_index(y, f->height);
+        for (int x = 0; x < cols; x++) {
+            int fx = fold_index(x, f->width);
+            int sy = fy, sx = fx;
+            if (f->sym == SYMMETRY_D4 && fx < fy) {
+                sy = fx;
+                sx = fy;
+            }
+            memcpy(cell_at(g, g->sand, y, x), cell_at(&f->grid, f->grid.sand, sy, sx), size);
+        }
+    }
+    return 0;
+}
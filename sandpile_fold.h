@@ -0,0 +1,73 @@
+#ifndef SANDPILE_FOLD_H
+#define SANDPILE_FOLD_H
+
+/*
+ * sandpile_fold.h
+ *
+ * Symmetry folding for the synchronous sweep. The rule commutes with the
+ * mirror images of the grid, so a mirror-symmetric initial state stays
+ * symmetric in every sweep and only one quadrant needs to be stored. If the
+ * grid is also square and symmetric about its diagonal (the full D4 group,
+ * as for the uniform start and an odd-sized centre pile) only the octant
+ * x >= y of that quadrant is computed.
+ *
+ * The folded grid is an ordinary sandpile_grid holding the top-left quadrant
+ * with the sink as its top and left border. Its bottom and right border are
+ * ghost cells mirrored from the quadrant before each sweep, as are the cells
+ * just below the diagonal in the octant case. The sweep count and the final
+ * state are those of the full synchronous sweep.
+ */
+
+#include "sandpile_grid.h"
+
+/* Symmetry of an initial state */
+typedef enum {
+    SYMMETRY_NONE,   /* no folding possible */
+    SYMMETRY_D2,     /* symmetric under both mirrors: quadrant */
+    SYMMETRY_D4      /* square and also symmetric about the diagonal: octant */
+} symmetry;
+
+typedef struct {
+    sandpile_grid grid;     /* folded quadrant, sink and ghost border included */
+    symmetry      sym;
+    int           height;   /* interior size of the full grid */
+    int           width;
+} fold_grid;
+
+/* Printable name of a symmetry */
+const char *symmetry_name(symmetry sym);
+
+/* Largest symmetry group of the current state of a full grid */
+symmetry symmetry_detect(const sandpile_grid *g);
+
+/**
+ * fold_init
+ * ---------
+ * Build a double-buffered folded grid of the same cell type from the current
+ * state of the full grid 'g', which must have symmetry 'sym' (not
+ * SYMMETRY_NONE). Returns 0 on success, -1 if allocation fails.
+ */
+int fold_init(fold_grid *f, const sandpile_grid *g, symmetry sym);
+
+/* Release the folded grid */
+void fold_free(fold_grid *f);
+
+/**
+ * fold_relax
+ * ----------
+ * Refresh the ghost cells of f->grid.sand and perform one synchronous sweep
+ * of the folded cells into f->grid.next. Returns 1 if any cell changed, 0
+ * otherwise. The caller swaps the buffers as for a full sweep.
+ */
+int fold_relax(fold_grid *f);
+
+/**
+ * fold_unfold
+ * -----------
+ * Allocate a single-buffered full grid 'g' and fill it with the current state
+ * of the folded grid mirrored into every quadrant, sink border included.
+ * Returns 0 on success, -1 if allocation fails.
+ */
+int fold_unfold(const fold_grid *f, sandpile_grid *g);
+
+#endif /* SANDPILE_FOLD_H */
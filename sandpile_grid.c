@@ -0,0 +1,140 @@
+/*
+ * sandpile_grid.c
+ *
+ * Allocation and cell-type conversion of the double-buffered sandpile grid.
+ * Loops carry OpenMP pragmas so that the OpenMP build converts in parallel;
+ * the serial build ignores them. The parallel loops split the grid into the
+ * row bands of sandpile_bands.h, so repacked buffers are first touched by
+ * the threads that relax them.
+ */
+
+#include <stdlib.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_grid.h"
+
+const char *cell_type_name(cell_type type) {
+    switch (type) {
+        case CELL_U8:  return "uint8";
+        case CELL_U16: return "uint16";
+        default:       return "uint32";
+    }
+}
+
+cell_type cell_type_for_max(uint32_t max) {
+    uint32_t bound = max | 3;  /* largest height the relaxation can reach */
+    if (bound <= UINT8_MAX) {
+        return CELL_U8;
+    }
+    if (bound <= UINT16_MAX) {
+        return CELL_U16;
+    }
+    return CELL_U32;
+}
+
+int grid_alloc(sandpile_grid *g, cell_type type, int rows, int cols, int buffers) {
+    size_t bytes = (size_t)rows * cols * cell_size(type);
+    g->sand = malloc(bytes);
+    g->next = buffers > 1 ? malloc(bytes) : NULL;
+    if (!g->sand || (buffers > 1 && !g->next)) {
+        free(g->sand);
+        free(g->next);
+        return -1;
+    }
+    g->type = type;
+    g->rows = rows;
+    g->cols = cols;
+    return 0;
+}
+
+void grid_free(sandpile_grid *g) {
+    free(g->sand);
+    free(g->next);
+    g->sand = g->next = NULL;
+}
+
+/* Largest height in rows [y0, y1) of a buffer of g's shape and type */
+static uint32_t buffer_max_rows(const sandpile_grid *g, const void *buf, int y0, int y1) {
+    uint32_t max = 0;
+    for (long i = (long)y0 * g->cols; i < (long)y1 * g->cols; i++) {
+        uint32_t v = cell_load(buf, g->type, i);
+        if (v > max) {
+            max = v;
+        }
+    }
+    return max;
+}
+
+uint32_t grid_max_rows(const sandpile_grid *g, int y0, int y1) {
+    return buffer_max_rows(g, g->sand, y0, y1);
+}
+
+uint32_t grid_bound_rows(const sandpile_grid *g, int y0, int y1) {
+    uint32_t max  = buffer_max_rows(g, g->sand, y0, y1);
+    uint32_t prev = g->next ? buffer_max_rows(g, g->next, y0, y1) : 0;
+    return max > prev ? max : prev;
+}
+
+uint32_t grid_max(const sandpile_grid *g) {
+    uint32_t max = 0;
+    #pragma omp parallel reduction(max:max)
+    {
+        int y0, y1;
+        band_touch_rows(g->rows, band_index(), band_count(), &y0, &y1);
+        max = grid_max_rows(g, y0, y1);
+    }
+    return max;
+}
+
+uint32_t grid_bound(const sandpile_grid *g) {
+    uint32_t max = 0;
+    #pragma omp parallel reduction(max:max)
+    {
+        int y0, y1;
+        band_touch_rows(g->rows, band_index(), band_count(), &y0, &y1);
+        max = grid_bound_rows(g, y0, y1);
+    }
+    return max;
+}
+
+int grid_narrow(sandpile_grid *g) {
+    if (g->type == CELL_U8) {
+        return 0;
+    }
+    cell_type type = cell_type_for_max(grid_bound(g));
+    if (type >= g->type) {
+        return 0;
+    }
+    return grid_repack(g, type) == 0;
+}
+
+int grid_repack(sandpile_grid *g, cell_type type) {
+    if (type == g->type) {
+        return 0;
+    }
+    sandpile_grid out;
+    if (grid_alloc(&out, type, g->rows, g->cols, g->next ? 2 : 1) != 0) {
+        return -1;
+    }
+
+    #pragma omp parallel
+    {
+        int y0, y1;
+        band_touch_rows(g->rows, band_index(), band_count(), &y0, &y1);
+        grid_repack_rows(g, &out, y0, y1);
+    }
+
+    grid_free(g);
+    *g = out;
+    return 0;
+}
+
+void grid_repack_rows(const sandpile_grid *g, sandpile_grid *out, int y0, int y1) {
+    /* Both buffers are converted: the sink border of 'next' must stay zero */
+    for (long i = (long)y0 * g->cols; i < (long)y1 * g->cols; i++) {
+        cell_store(out->sand, out->type, i, cell_load(g->sand, g->type, i));
+        if (out->next) {
+            cell_store(out->next, out->type, i, cell_load(g->next, g->type, i));
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef SANDPILE_GRID_H
+#define SANDPILE_GRID_H
+
+/*
+ * sandpile_grid.h
+ *
+ * Double-buffered sandpile grid whose cells are stored in the narrowest
+ * unsigned type that can hold every height the relaxation will reach.
+ *
+ * The synchronous rule never raises the maximum height past (max | 3): a
+ * cell becomes (v % 4) plus four quarters, and with every height at most
+ * 4k + 3 that sum is at most 3 + 4k. A grid whose initial maximum fits in a
+ * type therefore stays within it for the whole run, and as heights drop
+ * during the relaxation the grid can be narrowed further.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sandpile_kernel.h"
+
+/* Sweeps between checks whether the grid can be narrowed further */
+#define NARROW_INTERVAL 256
+
+typedef struct {
+    void     *sand;   /* current state, rows x cols cells */
+    void     *next;   /* next state, same shape (NULL for in-place engines) */
+    cell_type type;   /* storage type of both buffers */
+    int       rows;   /* including the sink border */
+    int       cols;
+} sandpile_grid;
+
+/* Size in bytes of a cell type (CELL_U8, CELL_U16, CELL_U32 are 1, 2, 4 bytes) */
+static inline size_t cell_size(cell_type type) {
+    return (size_t)1 << type;
+}
+
+/* Printable name of a cell type */
+const char *cell_type_name(cell_type type);
+
+/**
+ * cell_type_for_max
+ * -----------------
+ * Return the narrowest cell type that can hold a grid whose largest height
+ * is 'max' for the rest of the relaxation.
+ */
+cell_type cell_type_for_max(uint32_t max);
+
+/**
+ * grid_alloc
+ * ----------
+ * Allocate a rows x cols grid of the given type. 'buffers' is 2 for the
+ * double-buffered synchronous engines and 1 for engines that topple in
+ * place, which leave 'next' NULL. The cells are left uninitialised.
+ * Returns 0 on success, -1 if allocation fails.
+ */
+int grid_alloc(sandpile_grid *g, cell_type type, int rows, int cols, int buffers);
+
+/* Release the buffers */
+void grid_free(sandpile_grid *g);
+
+/* Largest height in the current state, sink border included */
+uint32_t grid_max(const sandpile_grid *g);
+
+/* Largest height in either buffer; 'next' holds the previous state, which
+ * may still be higher */
+uint32_t grid_bound(const sandpile_grid *g);
+
+/* grid_max and grid_bound over rows [y0, y1) only, for callers that split
+ * the rows among threads themselves */
+uint32_t grid_max_rows(const sandpile_grid *g, int y0, int y1);
+uint32_t grid_bound_rows(const sandpile_grid *g, int y0, int y1);
+
+/**
+ * grid_narrow
+ * -----------
+ * Repack the grid into the narrowest cell type that can hold the heights of
+ * both buffers for the rest of the relaxation, if that is narrower than its
+ * current type. Returns 1 if the type changed, 0 otherwise; if the narrower
+ * buffers cannot be allocated the grid simply keeps its current type.
+ */
+int grid_narrow(sandpile_grid *g);
+
+/**
+ * grid_repack
+ * -----------
+ * Convert the buffers to cells of 'type', which must be wide enough for
+ * every height they hold. Returns 0 on success, -1 if allocation fails, in
+ * which case the grid is left unchanged.
+ */
+int grid_repack(sandpile_grid *g, cell_type type);
+
+/* Convert rows [y0, y1) of both buffers of 'g' into 'out', a grid of the
+ * same shape allocated by the caller, for callers that split the rows among
+ * threads themselves */
+void grid_repack_rows(const sandpile_grid *g, sandpile_grid *out, int y0, int y1);
+
+/* Height at linear index 'idx' of a buffer of cells of 'type' */
+static inline uint32_t cell_load(const void *buf, cell_type type, size_t idx) {
+    switch (type) {
+        case CELL_U8:  return ((const uint8_t  *)buf)[idx];
+        case CELL_U16: return ((const uint16_t *)buf)[idx];
+        default:       return ((const uint32_t *)buf)[idx];
+    }
+}
+
+/* Store 'v' at index 'idx' of a buffer of cells of 'type' */
+static inline void cell_store(void *buf, cell_type type, size_t idx, uint32_t v) {
+    switch (type) {
+        case CELL_U8:  ((uint8_t  *)buf)[idx] = (uint8_t)v;  break;
+        case CELL_U16: ((uint16_t *)buf)[idx] = (uint16_t)v; break;
+        default:       ((uint32_t *)buf)[idx] = v;           break;
+    }
+}
+
+/* Height of the current state at linear index 'idx' */
+static inline uint32_t grid_get(const sandpile_grid *g, size_t idx) {
+    return cell_load(g->sand, g->type, idx);
+}
+
+/**
+ * grid_relax_span
+ * ---------------
+ * Compute 'width' cells of interior row y of the next state, starting at
+ * column x, with the selected row kernel. Returns 1 if any of them changed,
+ * 0 otherwise.
+ */
+static inline int grid_relax_span(const sandpile_grid *g, int y, int x, int width) {
+    size_t offset = ((size_t)y * g->cols + x) * cell_size(g->type);
+    return relax_row[g->type]((const char *)g->sand + offset,
+                              (char *)g->next + offset, g->cols, width);
+}
+
+/* Compute the whole interior row y of the next state */
+static inline int grid_relax_row(const sandpile_grid *g, int y) {
+    return grid_relax_span(g, y, 1, g->cols - 2);
+}
+
+/* Make the next state the current one */
+static inline void grid_swap(sandpile_grid *g) {
+    void *tmp = g->sand;
+    g->sand = g->next;
+    g->next = tmp;
+}
+
+#endif /* SANDPILE_GRID_H */
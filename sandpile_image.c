@@ -0,0 +1,312 @@
+/*
+ * sandpile_image.c
+ *
+ * Each pixel is stored as one 4-byte word from the lookup table, the next
+ * pixel overwriting its spare byte, so the encoding loop is a load, a table
+ * lookup and a store per cell. Only the last pixel of a row is copied as
+ * 3 bytes, to stay inside the caller's buffer.
+ *
+ * The file is sized up front and every pixel's offset follows from the
+ * header length, so each thread encodes the rows of its own band
+ * (sandpile_bands.h) and writes them with pwrite at their place in the
+ * file: encoding runs on every core, and the writes are independent. A
+ * pipe or device (a FIFO, /dev/null) cannot be written at an offset, so it
+ * gets the rows in order from a single thread.
+ *
+ * The PNG packs four cells per byte as palette indices. The rows are cut
+ * into chunks of about IMAGE_CHUNK packed bytes that are deflated on their
+ * own, in parallel, each ending on a byte boundary with a sync flush (the
+ * last one with the final block), so the compressed chunks concatenate into
+ * one zlib stream; their Adler-32 sums are combined in order. Chunks do not
+ * depend on the thread count, so neither does the file.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* pwrite, ftruncate under -std=c99 */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_image.h"
+
+/* Pixel bytes r, g, b of each stable value, padded to a word */
+static const unsigned char palette[4][4] = {
+    {0,   0,   0, 0},  /* black */
+    {0,   255, 0, 0},  /* green */
+    {0,   0, 255, 0},  /* blue  */
+    {255, 0,   0, 0}   /* red   */
+};
+
+/* Expand 'width' cells of one type, v > 3 mapping to black */
+#define ENCODE_ROW(T)                                                     \
+    do {                                                                  \
+        const T *cell = (const T *)g->sand + (size_t)y * g->cols + x;     \
+        for (int i = 0; i < width - 1; i++) {                             \
+            T v = cell[i];                                                \
+            memcpy(rgb + 3 * i, palette[v < 4 ? v : 0], 4);               \
+        }                                                                 \
+        T v = cell[width - 1];                                            \
+        memcpy(rgb + 3 * (width - 1), palette[v < 4 ? v : 0], 3);         \
+    } while (0)
+
+void image_encode_row(const sandpile_grid *g, int y, int x, int width, unsigned char *rgb) {
+    if (width <= 0) {
+        return;
+    }
+    switch (g->type) {
+        case CELL_U8:  ENCODE_ROW(uint8_t);  break;
+        case CELL_U16: ENCODE_ROW(uint16_t); break;
+        default:       ENCODE_ROW(uint32_t); break;
+    }
+}
+
+/* Write all of buf at 'offset', or at the current position if 'offset' is
+ * negative, retrying short writes */
+static int write_at(int fd, const unsigned char *buf, size_t bytes, off_t offset) {
+    while (bytes > 0) {
+        ssize_t n = offset < 0 ? write(fd, buf, bytes) : pwrite(fd, buf, bytes, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        bytes -= n;
+        if (offset >= 0) {
+            offset += n;
+        }
+    }
+    return 0;
+}
+
+int image_write_ppm(const sandpile_grid *g, const char *path) {
+    const int height = g->rows - 2, width = g->cols - 2;
+    const size_t row_bytes = 3 * (size_t)width;
+    const int chunk_rows = row_bytes < IMAGE_CHUNK ? (int)(IMAGE_CHUNK / row_bytes) : 1;
+
+    /* P6 header: width height, max colour 255 */
+    char header[64];
+    const int header_len = snprintf(header, sizeof header, "P6\n%d %d\n255\n", width, height);
+    const off_t total = header_len + (off_t)height * row_bytes;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return -1;
+    }
+    /* Only a regular file can be sized and written at offsets */
+    struct stat st;
+    const bool seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    int ok = (!seekable || ftruncate(fd, total) == 0) &&
+             write_at(fd, (const unsigned char *)header, header_len, seekable ? 0 : -1) == 0;
+
+    /* Each thread encodes and writes the rows of its band */
+    if (ok) {
+        #pragma omp parallel if (seekable) reduction(&&:ok)
+        {
+            int y0, y1;
+            band_rows(g->rows, band_index(), band_count(), &y0, &y1);
+            unsigned char *buf = y0 < y1 ? malloc(chunk_rows * row_bytes) : NULL;
+            int mine = y0 == y1 || buf != NULL;
+            for (int y = y0; mine && y < y1; y += chunk_rows) {
+                const int n = y + chunk_rows <= y1 ? chunk_rows : y1 - y;
+                for (int i = 0; i < n; i++) {
+                    image_encode_row(g, y + i, 1, width, buf + i * row_bytes);
+                }
+                const off_t at = seekable ? header_len + (off_t)(y - 1) * row_bytes : -1;
+                mine = write_at(fd, buf, n * row_bytes, at) == 0;
+            }
+            free(buf);
+            ok = ok && mine;
+        }
+    }
+
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+/* Pack 'width' cells of one type four to a byte, first cell in the top
+ * bits, v > 3 mapping to index 0 (black) */
+#define PACK_ROW(T)                                                       \
+    do {                                                                  \
+        const T *cell = (const T *)g->sand + (size_t)y * g->cols + x;     \
+        for (int i = 0; i < width; i += 4) {                              \
+            unsigned byte = 0;                                            \
+            for (int k = 0; k < 4; k++) {                                 \
+                T v = i + k < width ? cell[i + k] : 0;                    \
+                byte |= (unsigned)(v < 4 ? v : 0) << (6 - 2 * k);         \
+            }                                                             \
+            *out++ = (unsigned char)byte;                                 \
+        }                                                                 \
+    } while (0)
+
+/* Write one filter-type-0 scanline of row y: the filter byte, then the
+ * cells [x, x + width) packed by PACK_ROW */
+static void pack_row(const sandpile_grid *g, int y, int x, int width, unsigned char *out) {
+    *out++ = 0;
+    switch (g->type) {
+        case CELL_U8:  PACK_ROW(uint8_t);  break;
+        case CELL_U16: PACK_ROW(uint16_t); break;
+        default:       PACK_ROW(uint32_t); break;
+    }
+}
+
+/* Store v as 4 big-endian bytes */
+static void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* Write one PNG chunk: length, type, data and the CRC of type and data */
+static int put_chunk(FILE *fp, const char *type, const unsigned char *data, size_t len) {
+    unsigned char word[4];
+    put_be32(word, (uint32_t)len);
+    uLong crc = crc32(0L, (const Bytef *)type, 4);
+    for (size_t done = 0; done < len; ) {
+        uInt n = len - done < (1u << 30) ? (uInt)(len - done) : 1u << 30;
+        crc = crc32(crc, data + done, n);
+        done += n;
+    }
+    if (fwrite(word, 1, 4, fp) != 4 || fwrite(type, 1, 4, fp) != 4 ||
+        (len && fwrite(data, 1, len, fp) != len)) {
+        return -1;
+    }
+    put_be32(word, (uint32_t)crc);
+    return fwrite(word, 1, 4, fp) == 4 ? 0 : -1;
+}
+
+/* One chunk of scanlines and its compressed form */
+typedef struct {
+    unsigned char *data;   /* deflated scanlines */
+    size_t         len;
+    uLong          adler;  /* Adler-32 of the raw scanlines */
+    uLong          raw;    /* raw scanline bytes */
+} png_part;
+
+/**
+ * deflate_part
+ * ------------
+ * Pack rows [y0, y1) of the interior into scanlines and deflate them as a
+ * raw stream into 'part', ending with the final block if 'last' and with a
+ * sync flush otherwise. 'line' is scratch for one scanline. Returns 0 on
+ * success, -1 if memory runs out.
+ */
+static int deflate_part(const sandpile_grid *g, int y0, int y1, bool last,
+                        unsigned char *line, png_part *part) {
+    const int width = g->cols - 2;
+    const uInt line_bytes = 1 + (width + 3) / 4;
+    z_stream z = {0};
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+    part->raw = (uLong)(y1 - y0) * line_bytes;
+    part->len = deflateBound(&z, part->raw) + 16;  /* and the flush marker */
+    part->data = malloc(part->len);
+    if (!part->data) {
+        deflateEnd(&z);
+        return -1;
+    }
+    z.next_out = part->data;
+    z.avail_out = part->len;
+    part->adler = adler32(0L, Z_NULL, 0);
+
+    int status = Z_OK;
+    for (int y = y0; y < y1 && status == Z_OK; y++) {
+        pack_row(g, y, 1, width, line);
+        part->adler = adler32(part->adler, line, line_bytes);
+        z.next_in = line;
+        z.avail_in = line_bytes;
+        status = deflate(&z, y + 1 < y1 ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH);
+    }
+    /* A flush is only complete if it did not fill the buffer */
+    const bool done = last ? status == Z_STREAM_END : status == Z_OK && z.avail_out > 0;
+    part->len -= z.avail_out;
+    deflateEnd(&z);
+    return done ? 0 : -1;
+}
+
+int image_write_png(const sandpile_grid *g, const char *path) {
+    const int height = g->rows - 2, width = g->cols - 2;
+    const size_t line_bytes = 1 + (width + 3) / 4;
+    const int chunk_rows = line_bytes < IMAGE_CHUNK ? (int)(IMAGE_CHUNK / line_bytes) : 1;
+    const int parts = height > 0 ? (height + chunk_rows - 1) / chunk_rows : 0;
+
+    png_part *part = calloc(parts ? parts : 1, sizeof *part);
+    if (!part) {
+        return -1;
+    }
+
+    /* Deflate the chunks of rows in parallel */
+    int ok = 1;
+    #pragma omp parallel reduction(&&:ok)
+    {
+        unsigned char *line = malloc(line_bytes);
+        ok = line != NULL;
+        #pragma omp for schedule(dynamic)
+        for (int p = 0; p < parts; p++) {
+            const int y0 = 1 + p * chunk_rows;
+            const int y1 = y0 + chunk_rows <= height + 1 ? y0 + chunk_rows : height + 1;
+            if (ok && deflate_part(g, y0, y1, p == parts - 1, line, &part[p]) != 0) {
+                ok = 0;
+            }
+        }
+        free(line);
+    }
+
+    FILE *fp = ok ? fopen(path, "wb") : NULL;
+    if (fp) {
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        static const unsigned char zlib_header[2] = {0x78, 0x9c};  /* deflate, 32K window */
+        unsigned char ihdr[13];
+        put_be32(ihdr, width);
+        put_be32(ihdr + 4, height);
+        ihdr[8] = 2;    /* bits per index */
+        ihdr[9] = 3;    /* colour type: palette */
+        ihdr[10] = 0;   /* deflate */
+        ihdr[11] = 0;   /* adaptive filtering, all rows unfiltered */
+        ihdr[12] = 0;   /* no interlace */
+        unsigned char plte[12];
+        for (int v = 0; v < 4; v++) {
+            memcpy(plte + 3 * v, palette[v], 3);
+        }
+
+        /* The zlib header, the deflated chunks in order, then the Adler-32
+         * of all the scanlines, each in its own IDAT */
+        uLong adler = adler32(0L, Z_NULL, 0);
+        ok = fwrite(signature, 1, sizeof signature, fp) == sizeof signature &&
+             put_chunk(fp, "IHDR", ihdr, sizeof ihdr) == 0 &&
+             put_chunk(fp, "PLTE", plte, sizeof plte) == 0 &&
+             put_chunk(fp, "IDAT", zlib_header, sizeof zlib_header) == 0;
+        for (int p = 0; ok && p < parts; p++) {
+            adler = adler32_combine(adler, part[p].adler, part[p].raw);
+            ok = put_chunk(fp, "IDAT", part[p].data, part[p].len) == 0;
+        }
+        unsigned char trailer[4];
+        put_be32(trailer, (uint32_t)adler);
+        ok = ok && put_chunk(fp, "IDAT", trailer, sizeof trailer) == 0 &&
+             put_chunk(fp, "IEND", NULL, 0) == 0;
+        if (fclose(fp) != 0) {
+            ok = 0;
+        }
+    } else {
+        ok = 0;
+    }
+
+    for (int p = 0; p < parts; p++) {
+        free(part[p].data);
+    }
+    free(part);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,52 @@
+#ifndef SANDPILE_IMAGE_H
+#define SANDPILE_IMAGE_H
+
+/*
+ * sandpile_image.h
+ *
+ * Output of the final stable state as a binary PPM (P6) coloured by cell
+ * value: 0→black, 1→green, 2→blue, 3→red (anything else, which should not
+ * occur, is black). Cells are turned into pixels through a lookup table one
+ * row at a time, with no branch per cell, and the pixels leave in writes of
+ * about IMAGE_CHUNK bytes instead of three fputc calls per cell. With
+ * OpenMP every thread encodes and writes its own row band in parallel.
+ *
+ * The same image can be written as a 2-bit palette PNG instead, deflated
+ * in parallel chunks with zlib: four cells per byte before compression, so
+ * over twelve times smaller than the PPM, and viewable anywhere.
+ */
+
+#include "sandpile_grid.h"
+
+/* Bytes of pixels gathered before each write */
+#define IMAGE_CHUNK (1 << 20)
+
+/**
+ * image_encode_row
+ * ----------------
+ * Write the RGB pixels of cells [x, x + width) of row y of the current
+ * state to 'rgb', 3 * width bytes.
+ */
+void image_encode_row(const sandpile_grid *g, int y, int x, int width, unsigned char *rgb);
+
+/**
+ * image_write_ppm
+ * ---------------
+ * Write the interior of the current state (every cell but the sink border)
+ * to 'path' as a binary PPM, each thread writing its band at its offset.
+ * Returns 0 on success, -1 with errno set if the file cannot be written or
+ * a buffer cannot be allocated.
+ */
+int image_write_ppm(const sandpile_grid *g, const char *path);
+
+/**
+ * image_write_png
+ * ---------------
+ * Write the interior of the current state to 'path' as a PNG with a 2-bit
+ * palette of the same colours, deflating chunks of about IMAGE_CHUNK packed
+ * bytes on all threads. Returns 0 on success, -1 if the file cannot be
+ * written or memory runs out.
+ */
+int image_write_png(const sandpile_grid *g, const char *path);
+
+#endif /* SANDPILE_IMAGE_H */
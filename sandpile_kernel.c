@@ -0,0 +1,280 @@
+/*
+ * sandpile_kernel.c
+ *
+ * Vectorised row kernels for the synchronous sandpile update. Every
+ * instruction set variant (scalar, SSE4.1, AVX2, AVX-512) is compiled into
+ * the same binary through GCC target attributes, and relax_row_select()
+ * picks one at startup from the CPU's feature flags. The binary therefore
+ * needs no -march flag and runs on any x86-64 node of the queue.
+ *
+ * Each variant is instantiated for uint8_t, uint16_t and uint32_t cells by
+ * the DEFINE_*_KERNEL macros below. Cells are unsigned, so '% 4' and '/ 4'
+ * reduce to a mask and a logical shift (x86 has no 8-bit shift, so the
+ * 8-bit kernels shift 16-bit lanes and mask off the bits pulled in from the
+ * neighbouring byte). The changed flag is accumulated as the OR of
+ * (next ^ sand) over the row and tested once with a single ptest / mask
+ * test at the end instead of a compare and branch per cell. A row whose
+ * width is not a multiple of the vector ends on a vector overlapping the
+ * previous one, which recomputes a few cells with the same result, rather
+ * than on a scalar tail; this matters for the short rows of folded grids.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "sandpile_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SANDPILE_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * sync_compute_new_state_<type>
+ * -----------------------------
+ * Compute the next state of the cell at offset x of a row using a
+ * synchronous update. It sums the remainder of the current cell modulo 4
+ * plus one quarter of each of its four neighbors. Writes the result into
+ * the 'next' row and returns 1 if the cell value changed, 0 otherwise.
+ *
+ * relax_row_scalar_<type> applies it to a whole row.
+ */
+#define DEFINE_SCALAR_KERNEL(T, SUFFIX)                                        \
+static inline int sync_compute_new_state_##SUFFIX(const T *sand, T *next,    \
+                                                  int cols, int x) {         \
+    next[x] = (T)(sand[x] % 4                                                \
+                + sand[x - 1]    / 4  /* left neighbor */                    \
+                + sand[x + 1]    / 4  /* right neighbor */                   \
+                + sand[x - cols] / 4  /* above neighbor */                   \
+                + sand[x + cols] / 4); /* below neighbor */                  \
+    return next[x] != sand[x];                                               \
+}                                                                            \
+                                                                             \
+static int relax_row_scalar_##SUFFIX(const void *sand_, void *next_,         \
+                                     int cols, int width) {                  \
+    const T *sand = sand_;                                                   \
+    T *next = next_;                                                         \
+    int changed = 0;                                                         \
+    for (int x = 0; x < width; x++) {                                        \
+        changed |= sync_compute_new_state_##SUFFIX(sand, next, cols, x);     \
+    }                                                                        \
+    return changed;                                                          \
+}
+
+DEFINE_SCALAR_KERNEL(uint8_t,  u8)
+DEFINE_SCALAR_KERNEL(uint16_t, u16)
+DEFINE_SCALAR_KERNEL(uint32_t, u32)
+
+/**
+ * relax_bits_<isa>
+ * ----------------
+ * Bit-sliced kernel (see relax_bits_fn). The quarter of a height below 8 is
+ * its bit 2, so the four neighbour quarters are summed by a carry-save adder
+ * of their bit-2 planes into a 3-bit count, which a ripple adder then adds to
+ * the height modulo 4 (bits 0 and 1). The sum is at most 3 + 4 = 7. The word
+ * loop has no cross-iteration dependence besides the diff accumulator, so it
+ * is vectorised by the compiler for each instruction set.
+ */
+#define DEFINE_BITS_KERNEL(SUFFIX, ATTR)                                       \
+ATTR                                                                         \
+static int relax_bits_##SUFFIX(const uint64_t *restrict sand,                \
+                               uint64_t *restrict next,                      \
+                               const uint64_t *restrict mask,                \
+                               int plane, int words) {                       \
+    const uint64_t *b0 = sand, *b1 = sand + plane, *b2 = sand + 2 * plane;   \
+    const uint64_t *up = b2 - 3 * plane, *down = b2 + 3 * plane;             \
+    uint64_t diff = 0;                                                       \
+    for (int w = 0; w < words; w++) {                                        \
+        /* Bit i of l and r is the quarter of the left and right neighbour */\
+        uint64_t l = (b2[w] << 1) | (b2[w - 1] >> 63);                       \
+        uint64_t r = (b2[w] >> 1) | (b2[w + 1] << 63);                       \
+        uint64_t u = up[w], d = down[w];                                     \
+                                                                             \
+        /* s2 s1 s0 = l + r + u + d */                                       \
+        uint64_t t0 = l ^ r, k0 = l & r;                                     \
+        uint64_t t1 = u ^ d, k1 = u & d;                                     \
+        uint64_t s0 = t0 ^ t1, k2 = t0 & t1;                                 \
+        uint64_t s1 = k0 ^ k1 ^ k2;                                          \
+        uint64_t s2 = (k0 & k1) | (k2 & (k0 ^ k1));                          \
+                                                                             \
+        /* n2 n1 n0 = (b1 b0) + (s2 s1 s0) */                                \
+        uint64_t n0 = b0[w] ^ s0, c0 = b0[w] & s0;                           \
+        uint64_t n1 = b1[w] ^ s1 ^ c0;                                       \
+        uint64_t c1 = (b1[w] & s1) | (c0 & (b1[w] ^ s1));                    \
+        uint64_t n2 = s2 ^ c1;                                               \
+                                                                             \
+        n0 &= mask[w];                                                       \
+        n1 &= mask[w];                                                       \
+        n2 &= mask[w];                                                       \
+        next[w] = n0;                                                        \
+        next[plane + w] = n1;                                                \
+        next[2 * plane + w] = n2;                                            \
+        diff |= (n0 ^ b0[w]) | (n1 ^ b1[w]) | (n2 ^ b2[w]);                  \
+    }                                                                        \
+    return diff != 0;                                                        \
+}
+
+DEFINE_BITS_KERNEL(scalar, )
+
+#ifdef SANDPILE_X86
+
+DEFINE_BITS_KERNEL(sse41,  __attribute__((target("sse4.1"))))
+DEFINE_BITS_KERNEL(avx2,   __attribute__((target("avx2"))))
+DEFINE_BITS_KERNEL(avx512, __attribute__((target("avx512f,avx512bw"))))
+
+/*
+ * Vector kernel body shared by all instruction sets. VEC is the register
+ * type, LOAD/STORE unaligned accesses, AND/OR/XOR the bitwise operations,
+ * SET1/ADD/QUARTER the per-lane operations for the cell type, and ANY(d)
+ * tests whether any bit of d is set.
+ */
+#define ROW_KERNEL_BODY(T, SUFFIX, VEC, LOAD, STORE, AND, OR, XOR,            \
+                        SET1, ADD, QUARTER, ZERO, ANY)                       \
+    const T *sand = sand_;                                                   \
+    T *next = next_;                                                         \
+    const int lanes = (int)(sizeof(VEC) / sizeof(T));                        \
+    const VEC three = SET1(3);                                               \
+    VEC diff = ZERO();                                                       \
+    int x = 0;                                                               \
+                                                                             \
+    for (;;) {                                                               \
+        if (x + lanes > width) {                                             \
+            /* End on a vector overlapping the previous one; rows shorter */ \
+            /* than a vector are left to the scalar loop */                  \
+            if (x == width || width < lanes) {                               \
+                break;                                                       \
+            }                                                                \
+            x = width - lanes;                                               \
+        }                                                                    \
+        VEC c = LOAD((const VEC *)(sand + x));                               \
+        VEC l = LOAD((const VEC *)(sand + x - 1));                           \
+        VEC r = LOAD((const VEC *)(sand + x + 1));                           \
+        VEC u = LOAD((const VEC *)(sand + x - cols));                        \
+        VEC d = LOAD((const VEC *)(sand + x + cols));                        \
+                                                                             \
+        VEC v = AND(c, three);                                               \
+        v = ADD(v, QUARTER(l));                                              \
+        v = ADD(v, QUARTER(r));                                              \
+        v = ADD(v, QUARTER(u));                                              \
+        v = ADD(v, QUARTER(d));                                              \
+        STORE((VEC *)(next + x), v);                                         \
+                                                                             \
+        diff = OR(diff, XOR(v, c));                                          \
+        x += lanes;                                                          \
+    }                                                                        \
+                                                                             \
+    int changed = ANY(diff);                                                 \
+    for (; x < width; x++) {                                                 \
+        changed |= sync_compute_new_state_##SUFFIX(sand, next, cols, x);     \
+    }                                                                        \
+    return changed;
+
+/* SSE4.1: 16, 8 or 4 cells per register */
+#define SSE_QUARTER_U8(v)  _mm_and_si128(_mm_srli_epi16((v), 2), _mm_set1_epi8(0x3f))
+#define SSE_QUARTER_U16(v) _mm_srli_epi16((v), 2)
+#define SSE_QUARTER_U32(v) _mm_srli_epi32((v), 2)
+#define SSE_ANY(d)         (!_mm_testz_si128((d), (d)))
+
+#define DEFINE_SSE41_KERNEL(T, SUFFIX, SET1, ADD, QUARTER)                     \
+__attribute__((target("sse4.1")))                                             \
+static int relax_row_sse41_##SUFFIX(const void *sand_, void *next_,          \
+                                    int cols, int width) {                   \
+    ROW_KERNEL_BODY(T, SUFFIX, __m128i, _mm_loadu_si128, _mm_storeu_si128,   \
+                    _mm_and_si128, _mm_or_si128, _mm_xor_si128,              \
+                    SET1, ADD, QUARTER, _mm_setzero_si128, SSE_ANY)          \
+}
+
+DEFINE_SSE41_KERNEL(uint8_t,  u8,  _mm_set1_epi8,  _mm_add_epi8,  SSE_QUARTER_U8)
+DEFINE_SSE41_KERNEL(uint16_t, u16, _mm_set1_epi16, _mm_add_epi16, SSE_QUARTER_U16)
+DEFINE_SSE41_KERNEL(uint32_t, u32, _mm_set1_epi32, _mm_add_epi32, SSE_QUARTER_U32)
+
+/* AVX2: 32, 16 or 8 cells per register */
+#define AVX2_QUARTER_U8(v)  _mm256_and_si256(_mm256_srli_epi16((v), 2), _mm256_set1_epi8(0x3f))
+#define AVX2_QUARTER_U16(v) _mm256_srli_epi16((v), 2)
+#define AVX2_QUARTER_U32(v) _mm256_srli_epi32((v), 2)
+#define AVX2_ANY(d)         (!_mm256_testz_si256((d), (d)))
+
+#define DEFINE_AVX2_KERNEL(T, SUFFIX, SET1, ADD, QUARTER)                      \
+__attribute__((target("avx2")))                                               \
+static int relax_row_avx2_##SUFFIX(const void *sand_, void *next_,           \
+                                   int cols, int width) {                    \
+    ROW_KERNEL_BODY(T, SUFFIX, __m256i, _mm256_loadu_si256,                  \
+                    _mm256_storeu_si256, _mm256_and_si256, _mm256_or_si256,  \
+                    _mm256_xor_si256, SET1, ADD, QUARTER,                    \
+                    _mm256_setzero_si256, AVX2_ANY)                          \
+}
+
+DEFINE_AVX2_KERNEL(uint8_t,  u8,  _mm256_set1_epi8,  _mm256_add_epi8,  AVX2_QUARTER_U8)
+DEFINE_AVX2_KERNEL(uint16_t, u16, _mm256_set1_epi16, _mm256_add_epi16, AVX2_QUARTER_U16)
+DEFINE_AVX2_KERNEL(uint32_t, u32, _mm256_set1_epi32, _mm256_add_epi32, AVX2_QUARTER_U32)
+
+/* AVX-512 (F + BW for the 8- and 16-bit lanes): 64, 32 or 16 cells per register */
+#define AVX512_LOAD(p)        _mm512_loadu_si512((const void *)(p))
+#define AVX512_STORE(p, v)    _mm512_storeu_si512((void *)(p), (v))
+#define AVX512_QUARTER_U8(v)  _mm512_and_si512(_mm512_srli_epi16((v), 2), _mm512_set1_epi8(0x3f))
+#define AVX512_QUARTER_U16(v) _mm512_srli_epi16((v), 2)
+#define AVX512_QUARTER_U32(v) _mm512_srli_epi32((v), 2)
+#define AVX512_ANY(d)         (_mm512_test_epi64_mask((d), (d)) != 0)
+
+#define DEFINE_AVX512_KERNEL(T, SUFFIX, SET1, ADD, QUARTER)                    \
+__attribute__((target("avx512f,avx512bw")))                                   \
+static int relax_row_avx512_##SUFFIX(const void *sand_, void *next_,         \
+                                     int cols, int width) {                  \
+    ROW_KERNEL_BODY(T, SUFFIX, __m512i, AVX512_LOAD, AVX512_STORE,           \
+                    _mm512_and_si512, _mm512_or_si512, _mm512_xor_si512,     \
+                    SET1, ADD, QUARTER, _mm512_setzero_si512, AVX512_ANY)    \
+}
+
+DEFINE_AVX512_KERNEL(uint8_t,  u8,  _mm512_set1_epi8,  _mm512_add_epi8,  AVX512_QUARTER_U8)
+DEFINE_AVX512_KERNEL(uint16_t, u16, _mm512_set1_epi16, _mm512_add_epi16, AVX512_QUARTER_U16)
+DEFINE_AVX512_KERNEL(uint32_t, u32, _mm512_set1_epi32, _mm512_add_epi32, AVX512_QUARTER_U32)
+
+static int has_sse41(void)  { return __builtin_cpu_supports("sse4.1"); }
+static int has_avx2(void)   { return __builtin_cpu_supports("avx2"); }
+static int has_avx512(void) {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+
+#endif /* SANDPILE_X86 */
+
+static int has_scalar(void) { return 1; }
+
+/* Available kernels, widest first */
+#define KERNEL_SET(ISA) { relax_row_##ISA##_u8, relax_row_##ISA##_u16, relax_row_##ISA##_u32 }
+
+static const struct {
+    const char  *name;
+    relax_row_fn  fn[CELL_TYPES];
+    relax_bits_fn bits;
+    int         (*supported)(void);
+} kernels[] = {
+#ifdef SANDPILE_X86
+    { "avx512", KERNEL_SET(avx512), relax_bits_avx512, has_avx512 },
+    { "avx2",   KERNEL_SET(avx2),   relax_bits_avx2,   has_avx2   },
+    { "sse4.1", KERNEL_SET(sse41),  relax_bits_sse41,  has_sse41  },
+#endif
+    { "scalar", KERNEL_SET(scalar), relax_bits_scalar, has_scalar },
+};
+
+relax_row_fn relax_row[CELL_TYPES] = KERNEL_SET(scalar);
+relax_bits_fn relax_bits = relax_bits_scalar;
+
+const char *relax_row_select(const char *name) {
+#ifdef SANDPILE_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < sizeof kernels / sizeof kernels[0]; i++) {
+        if (name && strcmp(name, kernels[i].name) != 0) {
+            continue;
+        }
+        if (kernels[i].supported()) {
+            memcpy(relax_row, kernels[i].fn, sizeof relax_row);
+            relax_bits = kernels[i].bits;
+            return kernels[i].name;
+        }
+        if (name) {
+            return NULL;  /* requested kernel not supported by this CPU */
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef SANDPILE_KERNEL_H
+#define SANDPILE_KERNEL_H
+
+/*
+ * sandpile_kernel.h
+ *
+ * Row kernels for the synchronous sandpile update shared by the serial and
+ * OpenMP engines. A kernel computes one whole interior row of the 'next'
+ * grid from three rows of the 'sand' grid, which lets the inner loop be
+ * explicitly vectorised instead of calling the per-cell rule once per cell.
+ * Several instruction set variants are built in and one is chosen at
+ * runtime from the CPU's feature flags.
+ *
+ * Each kernel exists for 8-, 16- and 32-bit cells so that grids whose
+ * heights fit in a narrower type move less memory per sweep and fill more
+ * SIMD lanes per instruction.
+ */
+
+#include <stdint.h>
+
+/* Storage type of the grid cells */
+typedef enum {
+    CELL_U8,
+    CELL_U16,
+    CELL_U32,
+    CELL_TYPES    /* number of cell types */
+} cell_type;
+
+/**
+ * relax_row_fn
+ * ------------
+ * Compute one interior row of the next state with the synchronous rule
+ * (cell % 4 plus a quarter of each of its four neighbours).
+ *
+ * 'sand' points at the first interior cell (x = 1) of the row in the current
+ * grid and 'next' at the same cell in the next grid, both holding cells of
+ * the kernel's type. The rows above and below are reached through the 'cols'
+ * stride (in cells), and the ghost cells at sand[-1] and sand[width] supply
+ * the left and right neighbours of the end cells.
+ *
+ * Writes 'width' cells and returns 1 if any of them differs from its current
+ * value, 0 otherwise.
+ */
+typedef int (*relax_row_fn)(const void *sand, void *next, int cols, int width);
+
+/* Row kernels chosen by relax_row_select() (scalar until then), by cell type */
+extern relax_row_fn relax_row[CELL_TYPES];
+
+/* Heights below this fit the bit-sliced kernels' three bit planes */
+#define BITS_MAX_HEIGHT 8
+
+/**
+ * relax_bits_fn
+ * -------------
+ * Bit-sliced form of relax_row_fn for grids whose heights are all below
+ * BITS_MAX_HEIGHT, which the rule then never exceeds. A row is stored as
+ * three bit planes (bit 0, 1 and 2 of every height) of 'plane' words each,
+ * 64 cells per word, so the rule becomes a small adder network of bitwise
+ * operations evaluated for 64 cells at once.
+ *
+ * 'sand' and 'next' point at word 0 of the first plane of the row; the
+ * other planes follow at 'plane' word strides and the rows above and below
+ * at 3 * plane. The words at index -1 and 'words' of each plane are zero
+ * guards that supply the neighbours of the end bits. Each result word is
+ * ANDed with 'mask', which clears the sink columns and the padding bits.
+ *
+ * Writes 'words' words of each plane and returns 1 if any cell changed, 0
+ * otherwise.
+ */
+typedef int (*relax_bits_fn)(const uint64_t *sand, uint64_t *next,
+                             const uint64_t *mask, int plane, int words);
+
+/* Bit-sliced kernel chosen by relax_row_select() along with relax_row */
+extern relax_bits_fn relax_bits;
+
+/**
+ * relax_row_select
+ * ----------------
+ * Choose the row kernels for this CPU. With name == NULL the widest
+ * instruction set the CPU supports is used; otherwise 'name' must be one of
+ * "avx512", "avx2", "sse4.1" or "scalar". Returns the name of the selected
+ * kernels, or NULL if 'name' is unknown or not supported by this CPU.
+ */
+const char *relax_row_select(const char *name);
+
+#endif /* SANDPILE_KERNEL_H */
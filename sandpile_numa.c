@@ -0,0 +1,116 @@
+/*
+ * sandpile_numa.c
+ *
+ * Pinning through sched_setaffinity and placement queries through the
+ * move_pages system call, which with no target nodes only reports the node
+ * of each page.
+ */
+
+#define _GNU_SOURCE  /* sched_setaffinity, sched_getcpu, syscall */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sandpile_numa.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/* Pages sampled per band by page_node */
+#define NODE_SAMPLES 256
+#define MAX_NODES    64
+
+#ifdef __linux__
+
+int pin_thread(bind_policy policy, int tid, int team) {
+    if (policy == BIND_NONE) {
+        return -1;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+        return -1;
+    }
+    int cpus[CPU_SETSIZE], n = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) {
+            cpus[n++] = c;
+        }
+    }
+    if (n == 0) {
+        return -1;
+    }
+
+    /* Close packs consecutive threads onto consecutive allowed CPUs; spread
+     * places them n / team CPUs apart. Where the kernel numbers CPUs socket
+     * by socket (see lscpu) that fills one socket first or alternates
+     * between sockets respectively. */
+    int slot = policy == BIND_CLOSE ? tid % n : (int)((long)tid * n / team) % n;
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpus[slot], &one);
+    if (sched_setaffinity(0, sizeof one, &one) != 0) {
+        return -1;
+    }
+    return cpus[slot];
+}
+
+int current_cpu(void) {
+    return sched_getcpu();
+}
+
+int page_node(const void *addr, size_t bytes, double *share) {
+    const long page = sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t)addr / page, last = ((uintptr_t)addr + bytes - 1) / page;
+    const long pages = bytes ? (long)(last - first + 1) : 0;
+    const long count = pages < NODE_SAMPLES ? pages : NODE_SAMPLES;
+    if (count == 0) {
+        return -1;
+    }
+
+    void *where[NODE_SAMPLES];
+    int status[NODE_SAMPLES];
+    for (long i = 0; i < count; i++) {
+        where[i] = (void *)((first + (uintptr_t)(i * pages / count)) * page);
+    }
+    if (syscall(SYS_move_pages, 0, count, where, NULL, status, 0) != 0) {
+        return -1;
+    }
+
+    int votes[MAX_NODES] = {0};
+    for (long i = 0; i < count; i++) {
+        if (status[i] >= 0 && status[i] < MAX_NODES) {
+            votes[status[i]]++;
+        }
+    }
+    int node = -1;
+    for (int n = 0; n < MAX_NODES; n++) {
+        if (votes[n] > 0 && (node < 0 || votes[n] > votes[node])) {
+            node = n;
+        }
+    }
+    if (share && node >= 0) {
+        *share = (double)votes[node] / count;
+    }
+    return node;
+}
+
+#else /* !__linux__ */
+
+int pin_thread(bind_policy policy, int tid, int team) {
+    (void)policy; (void)tid; (void)team;
+    return -1;
+}
+
+int current_cpu(void) {
+    return -1;
+}
+
+int page_node(const void *addr, size_t bytes, double *share) {
+    (void)addr; (void)bytes; (void)share;
+    return -1;
+}
+
+#endif /* __linux__ */
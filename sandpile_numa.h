@@ -0,0 +1,43 @@
+#ifndef SANDPILE_NUMA_H
+#define SANDPILE_NUMA_H
+
+/*
+ * sandpile_numa.h
+ *
+ * Thread pinning and page placement queries for the OpenMP engine. Both
+ * use Linux system calls directly, so no NUMA library is needed at link
+ * time; elsewhere pinning is unavailable and placement is reported as
+ * unknown.
+ */
+
+#include <stddef.h>
+
+/* Thread placement selected with --bind= */
+typedef enum {
+    BIND_NONE,    /* leave placement to the OS and OMP_PROC_BIND */
+    BIND_CLOSE,   /* thread t on the t-th allowed CPU: fill one socket first */
+    BIND_SPREAD   /* threads spread evenly over the allowed CPUs */
+} bind_policy;
+
+/**
+ * pin_thread
+ * ----------
+ * Pin the calling thread, number 'tid' of a team of 'team', to one CPU of
+ * the process's affinity mask chosen by 'policy'. Returns the CPU, or -1 if
+ * the policy is BIND_NONE or pinning is not possible.
+ */
+int pin_thread(bind_policy policy, int tid, int team);
+
+/* CPU the calling thread is running on, or -1 if unknown */
+int current_cpu(void);
+
+/**
+ * page_node
+ * ---------
+ * NUMA node holding most of the pages of [addr, addr + bytes), or -1 if the
+ * placement cannot be queried. If 'share' is not NULL it receives the
+ * fraction of the pages on that node.
+ */
+int page_node(const void *addr, size_t bytes, double *share);
+
+#endif /* SANDPILE_NUMA_H */
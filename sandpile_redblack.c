@@ -0,0 +1,65 @@
+/*
+ * sandpile_redblack.c
+ *
+ * Red-black (checkerboard) in-place relaxation for the OpenMP engine.
+ * Cells with (x + y) even are red, the others black. Every neighbour of a
+ * red cell is black and vice versa, so all cells of one colour can be
+ * updated in parallel without any thread writing a cell another thread
+ * reads, and without a 'next' buffer.
+ *
+ * A phase of colour C applies the synchronous rule to the C cells only:
+ *
+ *     c = c % 4 + sum over the four neighbours n of n / 4
+ *
+ * The neighbours' quarters are the topplings of the other colour, whose
+ * own '% 4' is applied in the following phase, when those cells have not
+ * been written in between. Each phase therefore completes the topplings
+ * the other colour started and starts its own. The very first phase only
+ * gathers (c + sum n / 4) to start the red topplings without completing
+ * any. Termination is when two consecutive phases change nothing, which
+ * happens only once every cell is below 4; by the Abelian property the
+ * result equals the synchronous engine's.
+ */
+
+#include <stdbool.h>
+
+#include "sandpile_engine.h"
+
+/**
+ * relax_colour
+ * ------------
+ * Update every interior cell of the given colour (0 red, 1 black) in
+ * parallel. With 'complete' set each cell also completes its own pending
+ * topplings (v % 4). Returns 1 if any cell changed, 0 otherwise.
+ */
+static int relax_colour(uint32_t *sand, int rows, int cols, int colour, bool complete) {
+    int changed = 0;
+    #pragma omp parallel for reduction(|:changed) schedule(static)
+    for (int y = 1; y < rows - 1; y++) {
+        uint32_t *row = sand + (long)y * cols;
+        for (int x = 1 + ((1 + y + colour) & 1); x < cols - 1; x += 2) {
+            uint32_t v = row[x];
+            uint32_t next = (complete ? v % 4 : v)
+                          + row[x - 1]    / 4  /* left neighbor */
+                          + row[x + 1]    / 4  /* right neighbor */
+                          + row[x - cols] / 4  /* above neighbor */
+                          + row[x + cols] / 4; /* below neighbor */
+            changed |= next != v;
+            row[x] = next;
+        }
+    }
+    return changed;
+}
+
+long relax_redblack(uint32_t *sand, int rows, int cols) {
+    /* Black gathers the red topplings; red completes them next */
+    bool changed = relax_colour(sand, rows, cols, 1, false);
+    long phases = 1;
+    bool prev_changed = true;
+    while (changed || prev_changed) {
+        prev_changed = changed;
+        changed = relax_colour(sand, rows, cols, phases & 1 ? 0 : 1, true);
+        phases++;
+    }
+    return (phases + 1) / 2;  /* one sweep is a red and a black phase */
+}
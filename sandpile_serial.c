@@ -8,14 +8,39 @@
  * Also measures and reports the runtime of the relaxation phase.
  *
  * Compile with:
- *   gcc -DN=512 -DM=512 -std=c99 -O3 -Wall -o sandpile_serial sandpile_serial.c
+ *   gcc -DN=512 -DM=512 -std=c99 -O3 -Wall -o sandpile_serial sandpile_serial.c \
+ *       sandpile_grid.c sandpile_kernel.c sandpile_temporal.c sandpile_tiles.c \
+ *       sandpile_worklist.c sandpile_fold.c sandpile_bits.c sandpile_image.c -lz
+ *
+ * Run with --kernel=scalar|sse4.1|avx2|avx512 to override the row kernel
+ * picked from the CPU's feature flags, and with --init=centre to start from
+ * a single centre pile instead of 4 grains on every cell. --engine=async
+ * topples in place instead of the synchronous double-buffered sweep, and
+ * --engine=tiled skips tiles whose neighbourhood was stable last sweep.
+ * --engine=temporal advances cache-sized tiles --depth=K sweeps at a time.
+ * --engine=worklist visits only unstable cells, for sparse activity.
+ * --fold relaxes one quadrant (or octant) of a symmetric initial state.
+ * The sync engine switches to bit-sliced cells once every height is below
+ * 8 unless run with --bitslice=off. --format=png writes sandpile.png, a 2-bit
+ * palette PNG, instead of sandpile.ppm.
  */
 
+ #define _POSIX_C_SOURCE 199309L  /* clock_gettime under -std=c99 */
+
  #include <stdio.h>
  #include <stdlib.h>
  #include <stdbool.h>
+ #include <string.h>
  #include <time.h>
  
+ #include "sandpile_bits.h"
+ #include "sandpile_engine.h"
+ #include "sandpile_fold.h"
+ #include "sandpile_image.h"
+ #include "sandpile_grid.h"
+ #include "sandpile_temporal.h"
+ #include "sandpile_tiles.h"
+ 
  #ifndef N
  //#define N 512   /* number of interior rows */
  #define N 512
@@ -25,24 +50,14 @@
  #define M 512   /* number of interior columns */
  #endif
  
- /**
-  * sync_compute_new_state
-  * ----------------------
-  * Compute the next state of a single cell (y, x) in the sandpile grid
-  * using a synchronous update. It sums the remainder of the current cell
-  * modulo 4 plus one quarter of each of its four neighbors. Writes the
-  * result into the 'next' grid and returns 1 if the cell value changed,
-  * 0 otherwise.
-  */
- static inline int sync_compute_new_state(int *sand, int *next, int cols, int y, int x) {
-     int idx = y * cols + x;
-     next[idx] = sand[idx] % 4
-               + sand[idx - 1]    / 4  /* left neighbor */
-               + sand[idx + 1]    / 4  /* right neighbor */
-               + sand[idx - cols] / 4  /* above neighbor */
-               + sand[idx + cols] / 4; /* below neighbor */
-     return next[idx] != sand[idx];
- }
+ /* Relaxation engines selectable with --engine= */
+ enum engine {
+     ENGINE_SYNC,    /* synchronous double-buffered sweep (default) */
+     ENGINE_ASYNC,   /* in-place Gauss-Seidel toppling, see relax_async */
+     ENGINE_TILED,   /* synchronous sweep of the active tiles only */
+     ENGINE_TEMPORAL,/* synchronous sweeps, temporally blocked per tile */
+     ENGINE_WORKLIST /* in-place toppling of unstable cells, see relax_worklist */
+ };
  
  /**
   * main
@@ -52,93 +67,249 @@
   * the final configuration to a PPM image file.
   */
  int main(int argc, char *argv[]) {
+     /* Parse options */
+     const char *kernel = NULL;  /* NULL: widest kernel the CPU supports */
+     bool centre = false;        /* single centre pile instead of uniform 4 */
+     enum engine engine = ENGINE_SYNC;
+     int depth = TEMPORAL_DEPTH;  /* sweeps per block for --engine=temporal */
+     bool fold = false;          /* relax only the symmetry-reduced grid */
+     bool bitslice = true;       /* switch to bit planes once heights are small */
+     bool png = false;           /* write a palette PNG instead of the PPM */
+     for (int i = 1; i < argc; i++) {
+         if (strncmp(argv[i], "--kernel=", 9) == 0) {
+             kernel = argv[i] + 9;
+         } else if (strcmp(argv[i], "--init=centre") == 0) {
+             centre = true;
+         } else if (strcmp(argv[i], "--init=uniform") == 0) {
+             centre = false;
+         } else if (strcmp(argv[i], "--engine=sync") == 0) {
+             engine = ENGINE_SYNC;
+         } else if (strcmp(argv[i], "--engine=async") == 0) {
+             engine = ENGINE_ASYNC;
+         } else if (strcmp(argv[i], "--engine=tiled") == 0) {
+             engine = ENGINE_TILED;
+         } else if (strcmp(argv[i], "--engine=temporal") == 0) {
+             engine = ENGINE_TEMPORAL;
+         } else if (strcmp(argv[i], "--engine=worklist") == 0) {
+             engine = ENGINE_WORKLIST;
+         } else if (strcmp(argv[i], "--bitslice=auto") == 0) {
+             bitslice = true;
+         } else if (strcmp(argv[i], "--bitslice=off") == 0) {
+             bitslice = false;
+         } else if (strcmp(argv[i], "--format=ppm") == 0) {
+             png = false;
+         } else if (strcmp(argv[i], "--format=png") == 0) {
+             png = true;
+         } else if (strcmp(argv[i], "--fold") == 0) {
+             fold = true;
+         } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+             depth = atoi(argv[i] + 8);
+             if (depth < 1 || depth > TEMPORAL_MAX_DEPTH) {
+                 fprintf(stderr, "--depth must be between 1 and %d\n", TEMPORAL_MAX_DEPTH);
+                 return EXIT_FAILURE;
+             }
+         } else {
+             fprintf(stderr, "Usage: %s [--kernel=scalar|sse4.1|avx2|avx512]"
+                             " [--init=uniform|centre] [--engine=sync|async|tiled|temporal|worklist]"
+                             " [--depth=K] [--fold] [--bitslice=auto|off] [--format=ppm|png]\n",
+                     argv[0]);
+             return EXIT_FAILURE;
+         }
+     }
+     if (fold && engine != ENGINE_SYNC) {
+         fprintf(stderr, "--fold requires --engine=sync\n");
+         return EXIT_FAILURE;
+     }
+     const char *isa = relax_row_select(kernel);
+     if (!isa) {
+         fprintf(stderr, "Row kernel '%s' is unknown or not supported by this CPU\n", kernel);
+         return EXIT_FAILURE;
+     }
+     fprintf(stderr, "Row kernel: %s\n", isa);
+ 
      const int height = N;
      const int width  = M;
      const int rows = height + 2;  /* include sink border */
      const int cols = width  + 2;
  
-     /* Allocate two grids: current (sand) and next state (next) */
-     int *sand = malloc(rows * cols * sizeof(int));
-     int *next = malloc(rows * cols * sizeof(int));
-     if (!sand || !next) {
+     /* Allocate two grids: current (sand) and next state (next), or only
+      * 'sand' for the in-place engines. They start as 32-bit cells. */
+     const bool in_place = engine == ENGINE_ASYNC || engine == ENGINE_WORKLIST;
+     sandpile_grid grid;
+     if (grid_alloc(&grid, CELL_U32, rows, cols, in_place ? 1 : 2) != 0) {
          perror("malloc");
          return EXIT_FAILURE;
      }
+     uint32_t *sand = grid.sand;
+     uint32_t *next = grid.next;
  
      /* Initialize all cells (including border) to zero */
      for (int i = 0; i < rows * cols; i++) {
-         sand[i] = next[i] = 0;
+         sand[i] = 0;
+         if (next) {
+             next[i] = 0;
+         }
      }
  
-     /* Set every interior cell to 4 grains (unstable start) */
-     for (int y = 1; y <= height; y++) {
-         for (int x = 1; x <= width; x++) {
-             sand[y * cols + x] = 4;
+     if (centre) {
+         /* Alternative initialization: single huge centre pile */
+         int cy = height/2 + 1, cx = width/2 + 1;
+         sand[cy * cols + cx] = width * height;
+     } else {
+         /* Set every interior cell to 4 grains (unstable start) */
+         for (int y = 1; y <= height; y++) {
+             for (int x = 1; x <= width; x++) {
+                 sand[y * cols + x] = 4;
+             }
          }
      }
  
-     /* Alternative initialization: single huge centre pile
-     int cy = height/2 + 1, cx = width/2 + 1;
-     sand[cy * cols + cx] = width * height;
-     */
+     /* Keep only one quadrant or octant of a symmetric start. 'work' is
+      * the grid the synchronous sweep runs on. */
+     sandpile_grid *work = &grid;
+     fold_grid folded;
+     if (fold) {
+         symmetry sym = symmetry_detect(&grid);
+         fprintf(stderr, "Symmetry: %s\n", symmetry_name(sym));
+         if (sym != SYMMETRY_NONE) {
+             if (fold_init(&folded, &grid, sym) != 0) {
+                 perror("malloc");
+                 return EXIT_FAILURE;
+             }
+             grid_free(&grid);
+             work = &folded.grid;
+         } else {
+             fold = false;
+         }
+     }
+ 
+     /* Store cells in the narrowest type that holds every height reached.
+      * In-place toppling can pile grains higher, so it keeps 32-bit cells. */
+     if (!in_place) {
+         grid_narrow(work);
+     }
+     fprintf(stderr, "Cell type: %s\n", cell_type_name(work->type));
+ 
+     tile_map tiles;
+     if (engine == ENGINE_TILED && tiles_init(&tiles, height, width) != 0) {
+         perror("malloc");
+         return EXIT_FAILURE;
+     }
  
      /* Measure relaxation runtime */
      struct timespec t_start, t_end;
      clock_gettime(CLOCK_MONOTONIC, &t_start);
  
-     /* Relaxation: repeat until no cell changes */
-     bool changed = true;
-     while (changed) {
-         changed = false;
-         for (int y = 1; y <= height; y++) {
-             for (int x = 1; x <= width; x++) {
-                 /* Compute next state and accumulate change flag */
-                 changed |= sync_compute_new_state(sand, next, cols, y, x);
+     long iterations = 0;
+     if (in_place) {
+         iterations = engine == ENGINE_ASYNC ? relax_async(grid.sand, rows, cols)
+                                             : relax_worklist(grid.sand, rows, cols);
+         if (iterations < 0) {
+             perror("malloc");
+             return EXIT_FAILURE;
+         }
+     } else {
+         /* Relaxation: repeat until no cell changes */
+         bool changed = true;
+         long narrow_at = NARROW_INTERVAL;
+         long bits_at = 0;           /* next check for the bit-sliced switch */
+         bit_grid bits;
+         bool bitsliced = false;
+         bitslice = bitslice && engine == ENGINE_SYNC && !fold;
+         while (changed) {
+             /* Switch to bit planes once every height fits in three bits */
+             if (bitslice && !bitsliced && iterations >= bits_at) {
+                 bits_at = iterations + NARROW_INTERVAL;
+                 if (grid_max(work) < BITS_MAX_HEIGHT) {
+                     if (bits_init(&bits, work) != 0) {
+                         perror("malloc");
+                         return EXIT_FAILURE;
+                     }
+                     bitsliced = true;
+                     fprintf(stderr, "Cell type: bit-sliced after %ld sweeps\n", iterations);
+                 }
+             }
+ 
+             changed = false;
+             int sweeps = 1;  /* sweeps advanced by this pass */
+             if (engine == ENGINE_TEMPORAL) {
+                 /* 'depth' sweeps per cache-resident tile */
+                 int stable_at = temporal_relax(work, depth);
+                 if (stable_at < 0) {
+                     perror("malloc");
+                     return EXIT_FAILURE;
+                 }
+                 sweeps = stable_at ? stable_at : depth;
+                 changed = stable_at == 0;
+             } else if (engine == ENGINE_TILED) {
+                 /* Only recompute tiles next to last sweep's activity */
+                 changed = tiles_relax(&tiles, work);
+             } else if (fold) {
+                 changed = fold_relax(&folded);
+             } else if (bitsliced) {
+                 changed = bits_relax(&bits);
+             } else {
+                 for (int y = 1; y <= height; y++) {
+                     /* Compute next state of the row and accumulate change flag */
+                     changed |= grid_relax_row(work, y);
+                 }
              }
+             /* Swap buffers: 'next' becomes current, old 'sand' reused */
+             if (bitsliced) {
+                 bits_swap(&bits);
+             } else {
+                 grid_swap(work);
+             }
+             iterations += sweeps;
+ 
+             /* Narrow the cells as heights drop (centre-pile runs) */
+             if (!bitsliced && iterations >= narrow_at) {
+                 narrow_at = iterations + NARROW_INTERVAL;
+                 if (grid_narrow(work)) {
+                     fprintf(stderr, "Cell type: %s after %ld sweeps\n",
+                             cell_type_name(work->type), iterations);
+                 }
+             }
+         }
+         if (bitsliced) {
+             bits_store(&bits, work);
+             bits_free(&bits);
          }
-         /* Swap buffers: 'next' becomes current, old 'sand' reused */
-         int *tmp = sand;
-         sand = next;
-         next = tmp;
      }
  
      clock_gettime(CLOCK_MONOTONIC, &t_end);
      double elapsed = (t_end.tv_sec - t_start.tv_sec)
                      + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
      fprintf(stderr, "Relaxation runtime: %.6f seconds\n", elapsed);
- 
-     /* Write the final stable sandpile to a binary PPM (P6) */
-     FILE *fp = fopen("sandpile.ppm", "wb");
-     if (!fp) {
-         perror("fopen");
-         return EXIT_FAILURE;
+     if (engine == ENGINE_WORKLIST) {
+         fprintf(stderr, "Cell visits: %ld\n", iterations);
+     } else {
+         fprintf(stderr, "Iterations: %ld\n", iterations);
      }
-     /* P6 header: width height, max colour 255 */
-     fprintf(fp, "P6\n%d %d\n255\n", width, height);
- 
-     /* Emit pixel at each interior cell based on its final value */
-     for (int y = 1; y <= height; y++) {
-         for (int x = 1; x <= width; x++) {
-             int v = sand[y * cols + x];
-             unsigned char r, g, b;
-             switch (v) {
-                 case 0: r = 0;   g = 0;   b = 0;   break;  /* black */
-                 case 1: r = 0;   g = 255; b = 0;   break;  /* green */
-                 case 2: r = 0;   g = 0;   b = 255; break;  /* blue  */
-                 case 3: r = 255; g = 0;   b = 0;   break;  /* red   */
-                 default:
-                     r = g = b = 0;  /* should not occur */
-             }
-             fputc(r, fp);
-             fputc(g, fp);
-             fputc(b, fp);
+     if (engine == ENGINE_TILED) {
+         fprintf(stderr, "Active tiles: %.1f%% of %ld tile sweeps\n",
+                 100.0 * tiles.updated / tiles.visited, tiles.visited);
+         tiles_free(&tiles);
+     }
+ 
+     /* Mirror the folded state back into a full grid for the output */
+     if (fold) {
+         if (fold_unfold(&folded, &grid) != 0) {
+             perror("malloc");
+             return EXIT_FAILURE;
          }
+         fold_free(&folded);
+     }
+ 
+     /* Write the final stable sandpile to a binary PPM (P6) or a PNG */
+     const char *path = png ? "sandpile.png" : "sandpile.ppm";
+     if ((png ? image_write_png(&grid, path) : image_write_ppm(&grid, path)) != 0) {
+         perror(path);
+         return EXIT_FAILURE;
      }
-     fclose(fp);
-     fprintf(stderr, "Wrote sandpile.ppm (%dx%d)\n", width, height);
+     fprintf(stderr, "Wrote %s (%dx%d)\n", path, width, height);
  
      /* Free allocated memory */
-     free(sand);
-     free(next);
+     grid_free(&grid);
      return EXIT_SUCCESS;
  }
\ No newline at end of file
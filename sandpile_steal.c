@@ -0,0 +1,142 @@
+/*
+ * sandpile_steal.c
+ *
+ * Locked deques are enough here: a tile is thousands of cells, so the lock
+ * is cheap next to the work it hands out, and the deques are only refilled
+ * between sweeps.
+ */
+
+#include <stdlib.h>
+
+#include "sandpile_bands.h"
+#include "sandpile_steal.h"
+
+/* Tile rows [*ty0, *ty1) owned by thread 'tid' of 'team' */
+static void tile_band(const tile_map *t, int tid, int team, int *ty0, int *ty1) {
+    *ty0 = (int)((long)t->tiles_y * tid / team);
+    *ty1 = (int)((long)t->tiles_y * (tid + 1) / team);
+}
+
+int steal_init(steal_sched *s, const tile_map *t) {
+    s->threads = omp_get_max_threads();
+    s->stolen = 0;
+    s->deques = calloc(s->threads, sizeof *s->deques);
+    if (!s->deques) {
+        return -1;
+    }
+    /* The team can be smaller than requested (OMP_THREAD_LIMIT,
+     * OMP_DYNAMIC), and then a band more than its share: room for them all */
+    const size_t capacity = (size_t)t->tiles_y * t->tiles_x;
+    for (int d = 0; d < s->threads; d++) {
+        s->deques[d].tiles = malloc(capacity * sizeof *s->deques[d].tiles);
+        if (!s->deques[d].tiles) {
+            steal_free(s);
+            return -1;
+        }
+        omp_init_lock(&s->deques[d].lock);
+    }
+    return 0;
+}
+
+void steal_free(steal_sched *s) {
+    for (int d = 0; d < s->threads; d++) {
+        if (s->deques[d].tiles) {
+            omp_destroy_lock(&s->deques[d].lock);
+            free(s->deques[d].tiles);
+        }
+    }
+    free(s->deques);
+    s->deques = NULL;
+}
+
+/* Take the most recently queued tile of the own deque, or -1 if empty */
+static int take_bottom(tile_deque *q) {
+    int i = -1;
+    omp_set_lock(&q->lock);
+    if (q->bottom > q->top) {
+        i = q->tiles[--q->bottom];
+    }
+    omp_unset_lock(&q->lock);
+    return i;
+}
+
+/* Steal the oldest tile of another thread's deque, or -1 if empty */
+static int take_top(tile_deque *q) {
+    int i = -1;
+    omp_set_lock(&q->lock);
+    if (q->bottom > q->top) {
+        i = q->tiles[q->top++];
+    }
+    omp_unset_lock(&q->lock);
+    return i;
+}
+
+/* xorshift32 */
+static inline unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Steal a tile from a random victim; if 'team' random attempts fail, scan
+ * every deque once, and return -1 only if all of them are empty */
+static int steal(steal_sched *s, int tid, int team, unsigned *seed) {
+    for (int k = 0; k < team; k++) {
+        int v = (int)(next_random(seed) % team);
+        if (v != tid) {
+            int i = take_top(&s->deques[v]);
+            if (i >= 0) {
+                return i;
+            }
+        }
+    }
+    for (int v = 0; v < team; v++) {
+        int i = take_top(&s->deques[(tid + 1 + v) % team]);
+        if (i >= 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int steal_relax(steal_sched *s, tile_map *t, const sandpile_grid *g) {
+    long active = 0, stolen = 0;
+    int changed = 0;
+    #pragma omp parallel num_threads(s->threads) reduction(+:active, stolen) reduction(|:changed)
+    {
+        const int tid = band_index(), team = band_count();
+        tile_deque *own = &s->deques[tid];
+
+        /* Queue the own active tiles, in raster order */
+        int ty0, ty1;
+        tile_band(t, tid, team, &ty0, &ty1);
+        active = tiles_mark(t, ty0, ty1);
+        own->top = own->bottom = 0;
+        for (int i = ty0 * t->tiles_x; i < ty1 * t->tiles_x; i++) {
+            if (t->active[i]) {
+                own->tiles[own->bottom++] = i;
+            }
+        }
+        /* Changed flags are read by the neighbouring bands until here */
+        #pragma omp barrier
+
+        unsigned seed = 0x9e3779b9u * (unsigned)(tid + 1);
+        for (;;) {
+            int i = take_bottom(own);
+            if (i < 0) {
+                i = steal(s, tid, team, &seed);
+                if (i < 0) {
+                    break;
+                }
+                stolen++;
+            }
+            changed |= tiles_relax_one(t, g, i);
+        }
+    }
+    t->updated += active;
+    t->visited += (long)t->tiles_y * t->tiles_x;
+    s->stolen += stolen;
+    return changed;
+}
@@ -0,0 +1,61 @@
+#ifndef SANDPILE_STEAL_H
+#define SANDPILE_STEAL_H
+
+/*
+ * sandpile_steal.h
+ *
+ * Work-stealing scheduler for the active tiles of sandpile_tiles.h. Each
+ * thread owns a band of tile rows, in step with its row band from
+ * sandpile_bands.h so that it mostly works on memory it first touched, and
+ * queues its active tiles in a deque of its own. It takes work from the
+ * bottom of that deque; once it runs dry it steals from the top of randomly
+ * chosen other deques. A centre-pile front that sits in one band is then
+ * spread over the whole team instead of leaving every other thread idle at
+ * the barrier.
+ *
+ * No tiles are queued while a sweep runs, so a thread that finds every
+ * deque empty is done with the sweep.
+ */
+
+#include <omp.h>
+
+#include "sandpile_grid.h"
+#include "sandpile_tiles.h"
+
+/* Active tiles of one thread; taken at 'bottom' by the owner and at 'top' by
+ * thieves, under 'lock' */
+typedef struct {
+    omp_lock_t lock;
+    int       *tiles;    /* tile indices, 'top' .. 'bottom' - 1 still queued */
+    int        top;
+    int        bottom;
+    char       pad[64];  /* keep neighbouring deques off each other's line */
+} tile_deque;
+
+typedef struct {
+    int         threads;   /* deques, one per thread of the largest team */
+    tile_deque *deques;
+    long        stolen;    /* tiles run by a thread other than their owner */
+} steal_sched;
+
+/**
+ * steal_init
+ * ----------
+ * Set up one deque per thread for the tiles of 't'. Returns 0 on success,
+ * -1 if allocation fails.
+ */
+int steal_init(steal_sched *s, const tile_map *t);
+
+/* Release the deques */
+void steal_free(steal_sched *s);
+
+/**
+ * steal_relax
+ * -----------
+ * Perform one synchronous sweep from g->sand into g->next over the active
+ * tiles, scheduled by work stealing. Returns 1 if any cell changed, 0
+ * otherwise. The caller swaps the buffers as for a full sweep.
+ */
+int steal_relax(steal_sched *s, tile_map *t, const sandpile_grid *g);
+
+#endif /* SANDPILE_STEAL_H */
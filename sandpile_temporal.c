@@ -0,0 +1,112 @@
+/*
+ * sandpile_temporal.c
+ *
+ * Overlapped (trapezoidal) temporal blocking of the synchronous sweep. See
+ * sandpile_temporal.h. Each tile works on two private buffers laid out
+ * like the grid, with local row stride lc, so the ordinary row kernels do
+ * the computation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sandpile_temporal.h"
+
+static inline int imin(int a, int b) { return a < b ? a : b; }
+static inline int imax(int a, int b) { return a > b ? a : b; }
+
+/**
+ * advance_tile
+ * ------------
+ * Advance the tile with interior rows y0..y0+h-1 and columns x0..x0+w-1 by
+ * 'depth' sweeps in the scratch buffers 'a' and 'b' (each lr x lc cells)
+ * and write it to g->next. Returns a mask with bit j-1 set if sweep j
+ * changed any cell the tile computed.
+ */
+static uint64_t advance_tile(const sandpile_grid *g, int depth, int y0, int x0,
+                             int h, int w, char *a, char *b, int lc) {
+    const int height = g->rows - 2, width = g->cols - 2;
+    const size_t cs = cell_size(g->type);
+    const relax_row_fn kernel = relax_row[g->type];
+    /* Local cell (0, 0) is global cell (oy, ox) */
+    const int oy = y0 - depth, ox = x0 - depth;
+
+    /* Load the tile and its halo, clipped to the grid (sink included) */
+    int cy0 = imax(0, oy), cy1 = imin(g->rows - 1, y0 + h - 1 + depth);
+    int cx0 = imax(0, ox), cx1 = imin(g->cols - 1, x0 + w - 1 + depth);
+    for (int y = cy0; y <= cy1; y++) {
+        const char *src = (const char *)g->sand + ((size_t)y * g->cols + cx0) * cs;
+        size_t dst = ((size_t)(y - oy) * lc + (cx0 - ox)) * cs;
+        memcpy(a + dst, src, (size_t)(cx1 - cx0 + 1) * cs);
+        memcpy(b + dst, src, (size_t)(cx1 - cx0 + 1) * cs);
+    }
+
+    /* Sweep j computes the tile grown by depth - j cells, within the interior */
+    uint64_t mask = 0;
+    char *cur = a, *nxt = b;
+    for (int j = 1; j <= depth; j++) {
+        int e = depth - j;
+        int ry0 = imax(1, y0 - e), ry1 = imin(height, y0 + h - 1 + e);
+        int rx0 = imax(1, x0 - e), rx1 = imin(width,  x0 + w - 1 + e);
+        int changed = 0;
+        for (int y = ry0; y <= ry1; y++) {
+            size_t off = ((size_t)(y - oy) * lc + (rx0 - ox)) * cs;
+            changed |= kernel(cur + off, nxt + off, lc, rx1 - rx0 + 1);
+        }
+        if (changed) {
+            mask |= (uint64_t)1 << (j - 1);
+        }
+        char *tmp = cur;
+        cur = nxt;
+        nxt = tmp;
+    }
+
+    /* Write back the tile itself */
+    for (int y = y0; y < y0 + h; y++) {
+        char *dst = (char *)g->next + ((size_t)y * g->cols + x0) * cs;
+        memcpy(dst, cur + ((size_t)(y - oy) * lc + (x0 - ox)) * cs, (size_t)w * cs);
+    }
+    return mask;
+}
+
+int temporal_relax(const sandpile_grid *g, int depth) {
+    const int height = g->rows - 2, width = g->cols - 2;
+    const int ty_n = (height + TEMPORAL_ROWS - 1) / TEMPORAL_ROWS;
+    const int tx_n = (width  + TEMPORAL_COLS - 1) / TEMPORAL_COLS;
+    const int lr = TEMPORAL_ROWS + 2 * depth;
+    const int lc = TEMPORAL_COLS + 2 * depth;
+    const size_t bytes = (size_t)lr * lc * cell_size(g->type);
+
+    uint64_t mask = 0;
+    int failed = 0;
+    #pragma omp parallel reduction(|:mask) reduction(|:failed)
+    {
+        char *a = malloc(bytes);
+        char *b = malloc(bytes);
+        failed = !a || !b;
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int ty = 0; ty < ty_n; ty++) {
+            for (int tx = 0; tx < tx_n; tx++) {
+                if (failed) {
+                    continue;
+                }
+                int y0 = 1 + ty * TEMPORAL_ROWS, x0 = 1 + tx * TEMPORAL_COLS;
+                int h = imin(TEMPORAL_ROWS, height + 1 - y0);
+                int w = imin(TEMPORAL_COLS, width + 1 - x0);
+                mask |= advance_tile(g, depth, y0, x0, h, w, a, b, lc);
+            }
+        }
+        free(a);
+        free(b);
+    }
+    if (failed) {
+        return -1;
+    }
+
+    for (int j = 1; j <= depth; j++) {
+        if (!(mask >> (j - 1) & 1)) {
+            return j;
+        }
+    }
+    return 0;
+}
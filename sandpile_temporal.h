@@ -0,0 +1,40 @@
+#ifndef SANDPILE_TEMPORAL_H
+#define SANDPILE_TEMPORAL_H
+
+/*
+ * sandpile_temporal.h
+ *
+ * Temporal blocking for the synchronous engines. Instead of streaming the
+ * whole grid through memory once per sweep, each TEMPORAL_ROWS x
+ * TEMPORAL_COLS tile is copied together with a halo of 'depth' cells into
+ * a cache-resident buffer and advanced 'depth' sweeps there. The region
+ * that can still be computed exactly shrinks by one cell per sweep (a
+ * trapezoid in space-time), so after 'depth' sweeps exactly the tile
+ * itself is left and is written back. Halo cells are computed redundantly
+ * by neighbouring tiles, which costs a little extra work per block but
+ * reads and writes the grid once per 'depth' sweeps.
+ */
+
+#include "sandpile_grid.h"
+
+#define TEMPORAL_ROWS      64
+#define TEMPORAL_COLS      512
+#define TEMPORAL_DEPTH     8    /* default sweeps per block */
+#define TEMPORAL_MAX_DEPTH 64   /* per-sweep change flags fit a 64-bit mask */
+
+/**
+ * temporal_relax
+ * --------------
+ * Advance g->sand by 'depth' synchronous sweeps (1 <= depth <=
+ * TEMPORAL_MAX_DEPTH) and store the result in g->next; the caller swaps
+ * the buffers. Tiles are processed in parallel in the OpenMP build.
+ *
+ * Returns the number of the first of these sweeps (1..depth) that changed
+ * no cell, so that the caller can report the exact sweep count of the
+ * plain synchronous loop; the grid is stable from that sweep on, so the
+ * extra sweeps are no-ops. Returns 0 if every sweep changed something and
+ * -1 if the tile buffers cannot be allocated.
+ */
+int temporal_relax(const sandpile_grid *g, int depth);
+
+#endif /* SANDPILE_TEMPORAL_H */
@@ -0,0 +1,68 @@
+#ifndef SANDPILE_TILES_H
+#define SANDPILE_TILES_H
+
+/*
+ * sandpile_tiles.h
+ *
+ * Active-tile tracking for the synchronous engines. The interior is split
+ * into TILE_ROWS x TILE_COLS tiles, each with a flag recording whether it
+ * changed in the previous sweep. A tile is only recomputed if it or one of
+ * its four neighbours changed; otherwise none of its inputs changed and its
+ * next state is its current one.
+ *
+ * Skipping a tile leaves its cells in 'next' untouched. They still hold the
+ * state from before the previous sweep, which equals the current state
+ * because the tile did not change in that sweep, so the double buffer stays
+ * consistent and the sweep count matches the full sweep exactly.
+ */
+
+#include "sandpile_grid.h"
+
+#define TILE_ROWS 16
+#define TILE_COLS 256   /* wide tiles keep the row kernel's vector runs long */
+
+typedef struct {
+    int            tiles_y;   /* tiles per column of the grid */
+    int            tiles_x;   /* tiles per row of the grid */
+    unsigned char *changed;   /* tile changed in the previous sweep */
+    unsigned char *active;    /* tile is recomputed in this sweep */
+    long           updated;   /* tiles recomputed so far */
+    long           visited;   /* tiles swept so far, recomputed or not */
+} tile_map;
+
+/**
+ * tiles_init
+ * ----------
+ * Set up tile flags for a grid with 'height' x 'width' interior cells,
+ * with every tile active for the first sweep. Returns 0 on success, -1 if
+ * allocation fails.
+ */
+int tiles_init(tile_map *t, int height, int width);
+
+/* Release the tile flags */
+void tiles_free(tile_map *t);
+
+/**
+ * tiles_relax
+ * -----------
+ * Perform one synchronous sweep from g->sand into g->next, recomputing only
+ * the active tiles (in parallel in the OpenMP build). Returns 1 if any cell
+ * changed, 0 otherwise. The caller swaps the buffers as for a full sweep.
+ */
+int tiles_relax(tile_map *t, const sandpile_grid *g);
+
+/**
+ * tiles_mark
+ * ----------
+ * Set the active flags of the tiles in tile rows [ty0, ty1) from the
+ * changed flags of the previous sweep and return how many are active. Used
+ * by schedulers that split the tiles among threads themselves; the changed
+ * flags of the neighbouring rows must not be written meanwhile.
+ */
+long tiles_mark(tile_map *t, int ty0, int ty1);
+
+/* Recompute tile i (row-major index) and record whether it changed; returns
+ * 1 if it did, 0 otherwise */
+int tiles_relax_one(tile_map *t, const sandpile_grid *g, int i);
+
+#endif /* SANDPILE_TILES_H */